@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+#include <variant>
+#include <hash-map>
+
+// HashMap against std::unordered_map on the operations bench/maps.owo
+// performs: keys arrive boxed in std::any as they do from the interpreter
+// usage: maps [keys] [rounds]
+typedef std::variant<double, std::string> Key;
+
+static Key unbox(const std::any& key) {
+  if (const double* number = std::any_cast<double>(&key)) return *number;
+  return std::any_cast<const std::string&>(key);
+}
+
+template <typename F>
+static double time_ms(F run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? std::stoul(argv[1]) : 200000;
+  size_t rounds = argc > 2 ? std::stoul(argv[2]) : 4;
+
+  std::vector<std::any> numbers, strings;
+  for (size_t i = 0; i < n; ++i) {
+    numbers.emplace_back(static_cast<double>(i * 7));
+    strings.emplace_back("key" + std::to_string(i));
+  }
+
+  std::cout << "workload\thash_map_ms\tunordered_map_ms" << std::endl;
+  for (const auto* keys : { &numbers, &strings }) {
+    const char* name = keys == &numbers ? "numbers" : "strings";
+    double found = 0, expected = 0;
+
+    double flat = time_ms([&] {
+      HashMap map;
+      for (const std::any& key : *keys) {
+        uint64_t hash;
+        HashMap::hash(key, hash);
+        map.set(key, hash, key);
+      }
+      for (size_t r = 0; r < rounds; ++r) {
+        for (const std::any& key : *keys) {
+          uint64_t hash;
+          HashMap::hash(key, hash);
+          found += map.get(key, hash) != nullptr;
+        }
+      }
+      for (size_t i = 0; i < keys->size(); i += 2) {
+        uint64_t hash;
+        HashMap::hash((*keys)[i], hash);
+        map.remove((*keys)[i], hash);
+      }
+    });
+
+    double standard = time_ms([&] {
+      std::unordered_map<Key, std::any> map;
+      for (const std::any& key : *keys)
+        map[unbox(key)] = key;
+      for (size_t r = 0; r < rounds; ++r)
+        for (const std::any& key : *keys)
+          expected += map.find(unbox(key)) != map.end();
+      for (size_t i = 0; i < keys->size(); i += 2)
+        map.erase(unbox((*keys)[i]));
+    });
+
+    if (found != expected) {
+      std::cout << "lookups diverged" << std::endl;
+      return 70;
+    }
+    std::cout << name << "\t" << flat << "\t" << standard << std::endl;
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <owo>
+#include <scanner>
+#include <parser>
+
+// scan and parse throughput on a generated expression-heavy source
+// usage: parse [megabytes]
+static std::string generate(size_t bytes) {
+  std::string source;
+  for (size_t i = 0; source.size() < bytes; ++i) {
+    std::string n = std::to_string(i);
+    source += "fun f" + n + "(a, b, c) {\n";
+    source += "  if (a < b == b >= c) return -a * (b + c) / 2 - a % 3 << 1;\n";
+    source += "  var x = a ? b + 1 : c - 1, y = x & 255 | b ^ c;\n";
+    source += "  return f" + n + "(x + y * 2, !b, \"s\" + a) + g(a)(b, c);\n";
+    source += "}\n";
+  }
+  return source;
+}
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 8;
+  std::string source = generate(megabytes << 20);
+
+  std::ostringstream diagnostics;
+  owo reporter(diagnostics);
+
+  auto start = std::chrono::steady_clock::now();
+  Scanner scanner(source, reporter);
+  const std::vector<std::unique_ptr<Token>>& tokens = scanner.scan_tokens();
+  auto scanned = std::chrono::steady_clock::now();
+  Parser parser(tokens, reporter);
+  const std::vector<std::unique_ptr<Stmt>>& stmts = parser.parse();
+  auto parsed = std::chrono::steady_clock::now();
+  Parser preparser(tokens, reporter, true);
+  preparser.parse();
+  auto preparsed = std::chrono::steady_clock::now();
+
+  if (reporter.failed()) {
+    std::cout << diagnostics.str();
+    return 64;
+  }
+
+  double mb = source.size() / double(1 << 20);
+  double scan_s = std::chrono::duration<double>(scanned - start).count();
+  double parse_s = std::chrono::duration<double>(parsed - scanned).count();
+  double preparse_s = std::chrono::duration<double>(preparsed - parsed).count();
+  std::cout << mb << " MB, " << tokens.size() << " tokens, " << stmts.size() << " statements" << std::endl;
+  std::cout << "scan\t" << scan_s * 1000 << " ms\t" << mb / scan_s << " MB/s" << std::endl;
+  std::cout << "parse\t" << parse_s * 1000 << " ms\t" << mb / parse_s << " MB/s" << std::endl;
+  std::cout << "lazy\t" << preparse_s * 1000 << " ms\t" << mb / preparse_s << " MB/s" << std::endl;
+  return 0;
+}
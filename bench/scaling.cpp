@@ -0,0 +1,46 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <owo>
+#include <script>
+#include <worker-pool>
+
+// runs the same compiled script many times on 1..N worker threads
+// usage: scaling [script] [max_threads] [invocations]
+int main(int argc, char *argv[]) {
+  std::string path = argc > 1 ? argv[1] : "bench/fib.owo";
+  size_t max_threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+  size_t invocations = argc > 3 ? std::stoul(argv[3]) : 16;
+  if (max_threads == 0) max_threads = 1;
+
+  std::string source = owo::read_file(path);
+  std::ostringstream diagnostics;
+  owo reporter(diagnostics);
+  Script script(source, reporter);
+  if (!script.valid()) {
+    std::cout << diagnostics.str();
+    return 64;
+  }
+
+  double base = 0;
+  std::cout << "threads\ttime_ms\tspeedup" << std::endl;
+  for (size_t n = 1; n <= max_threads; ++n) {
+    WorkerPool pool(n);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RunResult> results = pool.run(script, invocations);
+    auto end = std::chrono::steady_clock::now();
+
+    for (const auto& result : results) {
+      if (result.status != 0 || result.output != results[0].output) {
+        std::cout << "invocation failed or diverged:\n" << result.output;
+        return 70;
+      }
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    if (n == 1) base = ms;
+    std::cout << n << "\t" << ms << "\t" << base / ms << std::endl;
+  }
+
+  return 0;
+}
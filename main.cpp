@@ -1,18 +1,61 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <owo>
 
 int main(int argc, char *argv[]) {
-  try {
-    if (argc > 2) {
-      std::cout << "Usage: owo [script]" << std::endl;
+  Options options;
+  std::vector<std::string> scripts;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--no-specialize")) {
+      options.specialize = false;
+    } else if (!std::strcmp(argv[i], "--lazy")) {
+      options.lazy_parse = true;
+    } else if (!std::strcmp(argv[i], "--no-jit")) {
+      options.jit = false;
+    } else if (!std::strncmp(argv[i], "--jit-threshold=", 16)) {
+      options.jit_threshold = std::max(1, std::atoi(argv[i] + 16));
+    } else if (!std::strcmp(argv[i], "--gc-stress")) {
+      options.gc_stress = true;
+    } else if (!std::strcmp(argv[i], "--allow-files")) {
+      options.allow_files = true;
+    } else if (!std::strcmp(argv[i], "--memoize")) {
+      options.memoize = true;
+    } else if (!std::strncmp(argv[i], "--max-depth=", 12)) {
+      options.max_depth = std::max(1, std::atoi(argv[i] + 12));
+    } else if (!std::strncmp(argv[i], "--max-steps=", 12)) {
+      options.max_steps = std::strtoull(argv[i] + 12, nullptr, 10);
+    } else if (!std::strncmp(argv[i], "--max-heap=", 11)) {
+      options.max_heap = std::strtoull(argv[i] + 11, nullptr, 10);
+    } else if (!std::strncmp(argv[i], "--timeout=", 10)) {
+      options.timeout_ms = std::strtoull(argv[i] + 10, nullptr, 10);
+    } else if (!std::strncmp(argv[i], "--snapshot=", 11)) {
+      options.snapshot = argv[i] + 11;
+    } else if (!std::strncmp(argv[i], "--save-snapshot=", 16)) {
+      options.save_snapshot = argv[i] + 16;
+    } else if (!std::strncmp(argv[i], "--", 2)) {
+      std::cout << "Usage: owo [--no-specialize] [--lazy] [--no-jit] [--jit-threshold=N] [--max-depth=N] [--max-steps=N] [--max-heap=BYTES] [--timeout=MS] [--snapshot=FILE] [--save-snapshot=FILE] [--allow-files (off by default)] [--memoize] [--gc-stress] [script...]" << std::endl;
       exit(64);
-    } else if (argc == 2) {
-      owo::run_file(argv[1]);
     } else {
-      owo::run_prompt();
+      scripts.push_back(argv[i]);
+    }
+  }
+
+  try {
+    owo session(std::cout, options);
+    if (scripts.size() > 1) {
+      session.run_batch(scripts);
+    } else if (scripts.size() == 1) {
+      session.run_file(scripts[0]);
+    } else {
+      session.run_prompt();
     }
   } catch (const std::runtime_error& error) {
+    // a missing script or a snapshot that won't load
     std::cout << error.what() << std::endl;
+    return 70;
   }
 
   return 0;
@@ -40,8 +40,8 @@ void AstPrinter::visitLiteralExpr(Literal& expr) {
     try {
       if (expr.value.type() == typeid(std::string))
         result_expr = std::any_cast<std::string>(expr.value);
-      else if (expr.value.type() == typeid(int))
-        result_expr = std::to_string(std::any_cast<int>(expr.value));
+      else if (expr.value.type() == typeid(int64_t))
+        result_expr = std::to_string(std::any_cast<int64_t>(expr.value));
       else if (expr.value.type() == typeid(double)) {
         double value = std::any_cast<double>(expr.value);
         std::ostringstream oss;
@@ -85,6 +85,32 @@ void AstPrinter::visitTernaryExpr(Ternary& expr) {
   result_expr = parenthesize("?:", exprs);
 }
 
+void AstPrinter::visitArrayLiteralExpr(ArrayLiteral& expr) {
+  std::vector<Expr*> exprs;
+  for (auto& element : expr.elements)
+    exprs.push_back(element.get());
+  result_expr = parenthesize("array", exprs);
+}
+
+void AstPrinter::visitIndexExpr(Index& expr) {
+  const std::vector<Expr*> exprs{expr.object.get(), expr.index.get()};
+  result_expr = parenthesize("[]", exprs);
+}
+
+void AstPrinter::visitMapLiteralExpr(MapLiteral& expr) {
+  std::vector<Expr*> exprs;
+  for (auto& [key, value] : expr.entries) {
+    exprs.push_back(key.get());
+    exprs.push_back(value.get());
+  }
+  result_expr = parenthesize("map", exprs);
+}
+
+void AstPrinter::visitIndexAssignExpr(IndexAssign& expr) {
+  const std::vector<Expr*> exprs{expr.target.get(), expr.value.get()};
+  result_expr = parenthesize("=", exprs);
+}
+
 void AstPrinter::visitExpressionStmt(Expression &stmt) {
 }
 
@@ -0,0 +1,76 @@
+#include <budget>
+#include <algorithm>
+
+Budget::Budget(uint64_t max_steps, uint64_t timeout_ms)
+  : limited(max_steps != 0), max_steps(max_steps), timed(timeout_ms != 0), timeout(timeout_ms) {}
+
+int64_t Budget::refill() {
+  if (!limited)
+    return timed ? clock_interval : INT64_MAX;
+  // a share is drawn on by other budgets at the same time, so it goes out
+  // in slices even without a clock to read
+  if (pool) {
+    uint64_t left = pool->load(std::memory_order_relaxed), next;
+    do next = std::min<uint64_t>(left, clock_interval);
+    while (!pool->compare_exchange_weak(left, left - next, std::memory_order_relaxed));
+    return static_cast<int64_t>(next);
+  }
+  int64_t next = static_cast<int64_t>(std::min<uint64_t>(steps_left, timed ? clock_interval : INT64_MAX));
+  steps_left -= next;
+  return next;
+}
+
+void Budget::start() {
+  pool = nullptr;
+  steps_left = max_steps;
+  deadline = std::chrono::steady_clock::now() + timeout;
+  countdown = refill();
+}
+
+void Budget::start(Share& share) {
+  pool = share.steps;
+  steps_left = 0;
+  deadline = share.deadline;
+  countdown = refill();
+}
+
+void Budget::settle() {
+  if (pool && limited)
+    pool->fetch_add(unspent(), std::memory_order_relaxed);
+  pool = nullptr;
+  countdown = 0;
+}
+
+void Budget::lend(Share& share) {
+  share.deadline = deadline;
+  if (!limited)
+    return;
+  uint64_t left = steps_left + unspent();
+  if (pool) {
+    // a worker lending on passes its own share down
+    pool->fetch_add(left, std::memory_order_relaxed);
+    share.steps = pool;
+  } else {
+    share.own.store(left, std::memory_order_relaxed);
+  }
+  steps_left = 0;
+  countdown = 0;
+}
+
+void Budget::reclaim(Share& share) {
+  if (!limited)
+    return;
+  if (!pool)
+    steps_left = share.own.load(std::memory_order_relaxed);
+  countdown = refill();
+}
+
+const char* Budget::checkpoint() {
+  int64_t next = refill();
+  if (limited && !next)
+    return "Step limit exceeded.";
+  if (timed && std::chrono::steady_clock::now() >= deadline)
+    return "Time limit exceeded.";
+  countdown = next - 1;
+  return nullptr;
+}
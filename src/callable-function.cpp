@@ -1,21 +1,45 @@
 #include <callable-function>
 #include <exceptions>
-#include <iostream>//temp
+#include <parser>
 
-CallableFunction::CallableFunction(const Function& declaration) 
-  : declaration(declaration), Callable("<fn " + declaration.name->lexeme + ">", declaration.params.size()) {}
+CallableFunction::CallableFunction(const Function& declaration, std::shared_ptr<Environment> closure)
+  : Callable("<fn " + declaration.name->lexeme + ">", declaration.params.size()), declaration(declaration), closure(std::move(closure)) {
+  this->closure->captured = true;
+}
+
+std::any CallableFunction::call(Interpreter& interpreter, Arguments arguments) {
+  return invoke(interpreter, declaration, closure, arguments);
+}
+
+std::any CallableFunction::invoke(Interpreter& interpreter, const Function& declaration, const std::shared_ptr<Environment>& closure, Arguments arguments) {
+  // memoized functions skip the JIT: native code would recompute what the
+  // table already knows
+  uint64_t hash;
+  MemoTable* memo = interpreter.memo_table(declaration, closure.get());
+  if (memo && MemoTable::key(arguments, hash)) {
+    if (const std::any* value = memo->find(hash, arguments))
+      return *value;
+    std::any result = run(interpreter, declaration, closure, arguments);
+    memo->store(hash, arguments, result);
+    return result;
+  }
+
+  std::any result;
+  if (interpreter.call_native(declaration, closure.get(), arguments, result))
+    return result;
+  return run(interpreter, declaration, closure, arguments);
+}
 
-std::any CallableFunction::call(Interpreter& interpreter, const std::vector<std::any>& arguments) {
-  Environment* env = new Environment(interpreter.env);
-  for (size_t i = 0; i < this->arity(); ++i) {
+std::any CallableFunction::run(Interpreter& interpreter, const Function& declaration, const std::shared_ptr<Environment>& closure, Arguments arguments) {
+  std::shared_ptr<Environment> env = interpreter.heap.make<Environment>(closure);
+  for (size_t i = 0; i < declaration.params.size(); ++i) {
     env->define(declaration.params[i]->lexeme, arguments[i], declaration.params[i]);
   }
 
   try {
-    interpreter.execute_block(declaration.body, env);
-    delete env;
+    interpreter.execute_block(Parser::body(declaration), env.get());
   } catch (const ReturnException& ret) {
     return ret.value;
   }
   return std::any(nullptr);
-}
+}
\ No newline at end of file
@@ -2,11 +2,11 @@
 
 Callable::Callable(const std::string& name, const int n_args, const call_t call_fn) : name(name), n_args(n_args), call_fn(call_fn) {}
 
-size_t Callable::arity() {
+size_t Callable::arity() const {
   return this->n_args;
 }
 
-std::any Callable::call(Interpreter &interpreter, const std::vector<std::any> &arguments) {
+std::any Callable::call(Interpreter &interpreter, Arguments arguments) {
   return this->call_fn(interpreter, arguments);
 }
 
@@ -0,0 +1,236 @@
+#include <coroutine>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#define OWO_COROUTINE 1
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef __x86_64__
+#include <ucontext.h>
+#endif
+#endif
+
+// room kept free below the deepest frame, as for MachineStack
+static const size_t reserve = 256 * 1024;
+
+#ifdef OWO_COROUTINE
+
+namespace {
+  // stacks of finished coroutines, kept for the next ones of the same size
+  struct Spares {
+    std::vector<std::pair<char*, size_t>> stacks;
+    ~Spares() {
+      size_t page = sysconf(_SC_PAGESIZE);
+      for (auto [base, size] : stacks)
+        munmap(base - page, size + page);
+    }
+  };
+  thread_local Spares spares;
+  const size_t max_spares = 8;
+  // what a reused stack keeps committed from its previous body
+  const size_t warm = 64 * 1024;
+
+  // one inaccessible guard page below each stack
+  char* take_stack(size_t size) {
+    for (size_t i = 0; i < spares.stacks.size(); ++i) {
+      if (spares.stacks[i].second != size) continue;
+      char* base = spares.stacks[i].first;
+      spares.stacks[i] = spares.stacks.back();
+      spares.stacks.pop_back();
+      return base;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    void* mapping = mmap(nullptr, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+      throw std::runtime_error("Could not map generator stack.");
+    mprotect(mapping, page, PROT_NONE);
+    return static_cast<char*>(mapping) + page;
+  }
+
+  void give_back(char* base, size_t size) {
+    if (spares.stacks.size() < max_spares) {
+      if (size > warm)
+        madvise(base, size - warm, MADV_DONTNEED);
+      spares.stacks.emplace_back(base, size);
+    } else {
+      size_t page = sysconf(_SC_PAGESIZE);
+      munmap(base - page, size + page);
+    }
+  }
+}
+
+#ifdef __x86_64__
+
+// saves the callee-saved registers and the float control words on the
+// current stack, stores the stack pointer in *from and pops the same from to
+extern "C" void owo_switch(void** from, void* to);
+// first return address on a new stack: calls r12(rbx)
+extern "C" void owo_coroutine_start();
+
+asm(R"(
+  .text
+  .p2align 4
+  .type owo_switch, @function
+owo_switch:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size owo_switch, .-owo_switch
+
+  .p2align 4
+  .type owo_coroutine_start, @function
+owo_coroutine_start:
+  .cfi_startproc
+  .cfi_undefined rip
+  movq %rbx, %rdi
+  callq *%r12
+  ud2
+  .cfi_endproc
+  .size owo_coroutine_start, .-owo_coroutine_start
+)");
+
+void Coroutine::start() {
+  // what owo_switch pops: control words, r15 to rbp, then the return address
+  void** sp = reinterpret_cast<void**>((reinterpret_cast<uintptr_t>(base + size) & ~uintptr_t(15)) - 80);
+  uint32_t* control = reinterpret_cast<uint32_t*>(sp);
+  control[0] = 0x1F80;
+  control[1] = 0x037F;
+  sp[1] = sp[2] = sp[3] = nullptr;
+  sp[4] = reinterpret_cast<void*>(&Coroutine::enter);
+  sp[5] = this;
+  sp[6] = nullptr;
+  sp[7] = reinterpret_cast<void*>(&owo_coroutine_start);
+  self = sp;
+}
+
+void Coroutine::resume() {
+  if (!base) {
+    base = take_stack(size);
+    start();
+  }
+  running = true;
+  owo_switch(&caller, self);
+  running = false;
+  if (error)
+    std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+void Coroutine::suspend() {
+  owo_switch(&self, caller);
+}
+
+Coroutine::~Coroutine() {
+  if (base)
+    give_back(base, size);
+}
+
+#else
+
+namespace {
+  // makecontext only passes ints, hand the coroutine over through here instead
+  thread_local Coroutine* starting = nullptr;
+  void (*entering)(Coroutine*) = nullptr;
+
+  void trampoline() {
+    entering(starting);
+  }
+}
+
+void Coroutine::start() {
+  ucontext_t* context = new ucontext_t();
+  getcontext(context);
+  context->uc_stack.ss_sp = base;
+  context->uc_stack.ss_size = size;
+  context->uc_link = nullptr;
+  makecontext(context, trampoline, 0);
+  self = context;
+  caller = new ucontext_t();
+}
+
+void Coroutine::resume() {
+  if (!base) {
+    base = take_stack(size);
+    start();
+  }
+  starting = this;
+  entering = &Coroutine::enter;
+  running = true;
+  swapcontext(static_cast<ucontext_t*>(caller), static_cast<ucontext_t*>(self));
+  running = false;
+  if (error)
+    std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+void Coroutine::suspend() {
+  swapcontext(static_cast<ucontext_t*>(self), static_cast<ucontext_t*>(caller));
+}
+
+Coroutine::~Coroutine() {
+  if (!base) return;
+  delete static_cast<ucontext_t*>(self);
+  delete static_cast<ucontext_t*>(caller);
+  give_back(base, size);
+}
+
+#endif
+
+Coroutine::Coroutine(size_t size, std::function<void()> body) : body(std::move(body)) {
+  long page = sysconf(_SC_PAGESIZE);
+  this->size = (size + reserve + page - 1) / page * page;
+}
+
+void Coroutine::enter(Coroutine* coroutine) {
+  try {
+    coroutine->body();
+  } catch (...) {
+    coroutine->error = std::current_exception();
+  }
+  coroutine->finished = true;
+  // never resumed again
+  coroutine->suspend();
+}
+
+bool Coroutine::exhausted() const {
+  char marker;
+  return running && &marker >= base && static_cast<size_t>(&marker - base) < reserve;
+}
+
+#else
+
+// no context switching here, so no generators either
+Coroutine::Coroutine(size_t size, std::function<void()> body) : body(std::move(body)), size(size) {}
+Coroutine::~Coroutine() {}
+
+void Coroutine::start() {}
+void Coroutine::enter(Coroutine*) {}
+
+void Coroutine::resume() {
+  throw std::runtime_error("Generators are not supported on this platform.");
+}
+
+void Coroutine::suspend() {}
+
+bool Coroutine::exhausted() const { return false; }
+
+#endif
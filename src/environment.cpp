@@ -3,12 +3,29 @@
 #include <exceptions>
 #include <iostream>
 
-Environment::Environment(Environment* enclosing) : enclosing(enclosing) {}
+std::atomic<uint32_t> Environment::epoch{1};
+
+Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(std::move(enclosing)) {}
+
+void Environment::trace(const visit_t& visit) const {
+  if (enclosing)
+    visit(enclosing.get());
+  for (const auto& [name, value] : values)
+    trace_value(value, visit);
+}
+
+void Environment::clear() {
+  values.clear();
+  enclosing.reset();
+}
 
 void Environment::define(const std::string& name, const std::any& value, const Token* token) {
   ValuesMap::iterator it = values.find(name);
   if (it == values.end()) {
     values[name] = value;
+    resize(sizeof(Environment) + values.size() * variable_bytes);
+    if (captured)
+      epoch.fetch_add(1, std::memory_order_relaxed);
     return;
   }
   throw RuntimeError("Variable '" + name + "' has already been declared.", token);
@@ -34,6 +51,27 @@ std::any Environment::assign(const std::string& name, const std::any& value, con
   throw RuntimeError("Undefined variable '" + name + "'.", token);
 }
 
+Environment* Environment::ancestor(size_t hops) {
+  Environment* env = this;
+  for (; env && hops > 0; --hops)
+    env = env->enclosing.get();
+  return env;
+}
+
+std::any* Environment::find(const std::string& name) {
+  ValuesMap::iterator it = values.find(name);
+  return it != values.end() ? &it->second : nullptr;
+}
+
+std::any* Environment::lookup(const std::string& name, size_t& hops) {
+  hops = 0;
+  for (Environment* env = this; env; env = env->enclosing.get(), ++hops) {
+    if (std::any* value = env->find(name))
+      return value;
+  }
+  return nullptr;
+}
+
 void Environment::show_all() {
   for (const auto& [key, value] : values)
     std::cout << key << " = " << value << std::endl;
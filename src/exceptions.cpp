@@ -2,4 +2,6 @@
 
 RuntimeError::RuntimeError(const std::string& message, const Token* token) : std::runtime_error(message), token(token) {}
 
+BudgetError::BudgetError(const std::string& message, const Token* token) : RuntimeError(message, token) {}
+
 ReturnException::ReturnException(const std::any& value) : value(value) {}
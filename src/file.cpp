@@ -0,0 +1,129 @@
+#include <file>
+#include <exceptions>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read size for files that aren't mapped
+static const size_t chunk = 64 * 1024;
+// consumed mapped bytes given back at a time
+static const size_t release_step = 16 * 1024 * 1024;
+
+File::File(const std::string& path, int fd) : path(path), fd(fd) {
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      data = static_cast<const char*>(mapping);
+      size = info.st_size;
+      madvise(mapping, size, MADV_SEQUENTIAL);
+      return;
+    }
+  }
+  buffer.resize(chunk);
+}
+
+file_t File::open(const std::string& path) {
+  // non-blocking, so that opening a FIFO doesn't wait for a writer
+  int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    throw RuntimeError("Could not open '" + path + "': " + std::strerror(errno) + ".", nullptr);
+  // pipes, terminals and devices can block a read past every budget, or
+  // never end
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    throw RuntimeError("Could not open '" + path + "': not a regular file.", nullptr);
+  }
+  return file_t(new File(path, fd));
+}
+
+File::~File() {
+  close();
+}
+
+void File::close() {
+  if (data)
+    munmap(const_cast<char*>(data), size);
+  if (fd >= 0)
+    ::close(fd);
+  data = nullptr;
+  fd = -1;
+  buffer = std::vector<char>();
+  begin = end = 0;
+}
+
+const char* File::available(size_t& count) {
+  if (data) {
+    count = size - at;
+    return count ? data + at : nullptr;
+  }
+  while (begin == end && !finished) {
+    ssize_t got = ::read(fd, buffer.data(), buffer.size());
+    if (got < 0 && errno == EINTR)
+      continue;
+    // a script must not take a failed read for a short file
+    if (got < 0)
+      throw RuntimeError("Could not read '" + path + "': " + std::strerror(errno) + ".", nullptr);
+    if (got == 0)
+      finished = true;
+    else
+      begin = 0, end = got;
+  }
+  count = end - begin;
+  return count ? buffer.data() + begin : nullptr;
+}
+
+void File::consume(size_t count) {
+  if (!data) {
+    begin += count;
+    return;
+  }
+  at += count;
+  // the mapping is read once front to back, so pages behind the cursor
+  // would only sit in memory until the file is closed
+  if (at - released >= release_step) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t until = at / page * page;
+    madvise(const_cast<char*>(data) + released, until - released, MADV_DONTNEED);
+    released = until;
+  }
+}
+
+bool File::read_line(std::string& line) {
+  size_t count;
+  const char* bytes = available(count);
+  if (!bytes)
+    return false;
+  do {
+    const char* newline = static_cast<const char*>(std::memchr(bytes, '\n', count));
+    if (newline) {
+      line.append(bytes, newline - bytes);
+      consume(newline - bytes + 1);
+      break;
+    }
+    line.append(bytes, count);
+    consume(count);
+  } while ((bytes = available(count)));
+  if (!line.empty() && line.back() == '\r')
+    line.pop_back();
+  return true;
+}
+
+bool File::read(size_t count, std::string& bytes) {
+  size_t ready;
+  const char* from = available(ready);
+  if (!from)
+    return false;
+  do {
+    size_t taken = std::min(count, ready);
+    bytes.append(from, taken);
+    consume(taken);
+    count -= taken;
+  } while (count && (from = available(ready)));
+  return true;
+}
@@ -0,0 +1,81 @@
+#include <generator>
+#include <exceptions>
+#include <callable-function>
+
+// thrown from the yield of a generator dropped while suspended, unwinding
+// its body; nothing in the interpreter catches it
+struct GeneratorExit {};
+
+Generator::Generator(Interpreter& interpreter, std::any function, size_t stack_size)
+  : interpreter(interpreter), function(std::move(function)), coroutine(stack_size, [this] {
+      // the body's frames keep their own reference while it runs
+      this->interpreter.call(this->function, {});
+    }) {
+  scope = std::any_cast<const CallableFunction&>(this->function).closure;
+  strand.env = scope.get();
+  strand.generator = this;
+}
+
+Generator::~Generator() {
+  cancel();
+}
+
+void Generator::cancel() {
+  if (!coroutine.started() || coroutine.done()) return;
+  cancelled = true;
+  interpreter.swap(strand);
+  try {
+    coroutine.resume();
+  } catch (...) {}
+  interpreter.swap(strand);
+  interpreter.suspended.erase(this);
+}
+
+std::any Generator::next() {
+  if (coroutine.done()) return nullptr;
+  if (coroutine.is_running())
+    throw RuntimeError("Generator is already running.", nullptr);
+
+  // the body may drop the last reference to its own generator
+  std::shared_ptr<GcObject> self = shared_from_this();
+  interpreter.swap(strand);
+  try {
+    coroutine.resume();
+  } catch (...) {
+    interpreter.swap(strand);
+    interpreter.suspended.erase(this);
+    throw;
+  }
+  interpreter.swap(strand);
+  if (coroutine.done())
+    interpreter.suspended.erase(this);
+  else
+    interpreter.suspended.insert(this);
+  std::any result = std::move(value);
+  value = nullptr;
+  return result;
+}
+
+void Generator::yield(std::any value) {
+  this->value = std::move(value);
+  coroutine.suspend();
+  if (cancelled)
+    throw GeneratorExit();
+}
+
+void Generator::trace(const visit_t& visit) const {
+  trace_value(function, visit);
+  visit(scope.get());
+  trace_value(value, visit);
+  for (const std::any& arg : strand.stack)
+    trace_value(arg, visit);
+}
+
+// the stack keeps its size, the frames of a suspended body still pop it.
+// scope stays for the body to unwind into; it lets go of its own values
+void Generator::clear() {
+  function = nullptr;
+  value = nullptr;
+  for (std::any& arg : strand.stack)
+    arg = nullptr;
+}
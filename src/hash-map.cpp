@@ -0,0 +1,164 @@
+#include <hash-map>
+#include <number>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+static uint64_t mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  return hash ^ (hash >> 33);
+}
+
+// numbers key by value: integral doubles are folded into INTEGER
+HashMap::Kind HashMap::kind(const std::any& key, int64_t& integer) {
+  if (key.type() == typeid(std::string))
+    return STRING;
+  return exact_integer(key, integer) ? INTEGER : REAL;
+}
+
+bool HashMap::hash(const std::any& key, uint64_t& hash) {
+  if (is_number(key)) {
+    int64_t integer;
+    if (kind(key, integer) == INTEGER) {
+      hash = mix(static_cast<uint64_t>(integer));
+      return true;
+    }
+    double value = std::any_cast<double>(key);
+    if (std::isnan(value)) return false;
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    hash = mix(bits);
+    return true;
+  }
+  if (const std::string* string = std::any_cast<std::string>(&key)) {
+    // FNV-1a, tagged so that strings and numbers rarely share a hash
+    hash = 0xCBF29CE484222325ull;
+    for (unsigned char c : *string)
+      hash = (hash ^ c) * 0x100000001B3ull;
+    hash = mix(hash ^ 0x5354);
+    return true;
+  }
+  return false;
+}
+
+size_t HashMap::size() const { return live; }
+
+bool HashMap::matches(const Entry& entry, uint64_t hash, const std::any& key) const {
+  if (entry.hash != hash) return false;
+  int64_t integer;
+  switch (kind(key, integer)) {
+  case INTEGER: return entry.kind == INTEGER && entry.integer == integer;
+  case REAL: return entry.kind == REAL && entry.number == std::any_cast<double>(key);
+  default: return entry.kind == STRING && entry.string == std::any_cast<const std::string&>(key);
+  }
+}
+
+size_t HashMap::probe(uint64_t hash, const std::any& key, bool& found) const {
+  size_t mask = buckets.size() - 1;
+  size_t free = SIZE_MAX;
+  uint32_t tag = static_cast<uint32_t>(hash);
+
+  for (size_t i = (hash >> 32) & mask;; i = (i + 1) & mask) {
+    const Bucket& bucket = buckets[i];
+    if (bucket.entry == EMPTY) {
+      found = false;
+      return free != SIZE_MAX ? free : i;
+    }
+    if (bucket.entry == DELETED) {
+      if (free == SIZE_MAX) free = i;
+    } else if (bucket.tag == tag && matches(entries[bucket.entry], hash, key)) {
+      found = true;
+      return i;
+    }
+  }
+}
+
+void HashMap::account() {
+  resize(sizeof(HashMap) + entries.capacity() * sizeof(Entry) + buckets.capacity() * sizeof(Bucket));
+}
+
+// drops dead entries and rehashes everything into capacity buckets
+void HashMap::rebuild(size_t capacity) {
+  std::vector<Entry> kept;
+  kept.reserve(live);
+  for (Entry& entry : entries)
+    if (entry.live) kept.push_back(std::move(entry));
+  entries = std::move(kept);
+
+  buckets.assign(capacity, Bucket{ EMPTY, 0 });
+  size_t mask = capacity - 1;
+  for (size_t e = 0; e < entries.size(); ++e) {
+    size_t i = (entries[e].hash >> 32) & mask;
+    while (buckets[i].entry != EMPTY)
+      i = (i + 1) & mask;
+    buckets[i] = { static_cast<uint32_t>(e), static_cast<uint32_t>(entries[e].hash) };
+  }
+  used = entries.size();
+  account();
+}
+
+const std::any* HashMap::get(const std::any& key, uint64_t hash) const {
+  if (!live) return nullptr;
+  bool found;
+  size_t i = probe(hash, key, found);
+  return found ? &entries[buckets[i].entry].value : nullptr;
+}
+
+void HashMap::set(const std::any& key, uint64_t hash, const std::any& value) {
+  // keep at most 3/4 of the buckets in use, tombstones counting. entries
+  // can outnumber used buckets when inserts land on tombstones
+  if (4 * (std::max(used, entries.size()) + 1) > 3 * buckets.size())
+    rebuild(std::max<size_t>(8, 4 * (live + 1) > 3 * buckets.size() / 2 ? 2 * buckets.size() : buckets.size()));
+
+  bool found;
+  size_t i = probe(hash, key, found);
+  if (found) {
+    entries[buckets[i].entry].value = value;
+    return;
+  }
+
+  Entry entry{ hash, true, REAL, 0, 0, std::string(), value };
+  entry.kind = kind(key, entry.integer);
+  if (entry.kind == REAL)
+    entry.number = std::any_cast<double>(key);
+  else if (entry.kind == STRING)
+    entry.string = std::any_cast<const std::string&>(key);
+
+  if (buckets[i].entry == EMPTY) ++used;
+  buckets[i] = { static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(hash) };
+  size_t capacity = entries.capacity();
+  entries.push_back(std::move(entry));
+  if (entries.capacity() != capacity)
+    account();
+  ++live;
+}
+
+bool HashMap::remove(const std::any& key, uint64_t hash) {
+  if (!live) return false;
+  bool found;
+  size_t i = probe(hash, key, found);
+  if (!found) return false;
+
+  Entry& entry = entries[buckets[i].entry];
+  entry.live = false;
+  entry.string = std::string();
+  entry.value = std::any();
+  buckets[i].entry = DELETED;
+  --live;
+  return true;
+}
+
+void HashMap::trace(const visit_t& visit) const {
+  for (const Entry& entry : entries)
+    if (entry.live) trace_value(entry.value, visit);
+}
+
+void HashMap::clear() {
+  entries.clear();
+  buckets.clear();
+  live = 0;
+  used = 0;
+}
\ No newline at end of file
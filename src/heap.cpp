@@ -0,0 +1,142 @@
+#include <heap>
+#include <callable-function>
+#include <typed-array>
+#include <hash-map>
+#include <generator>
+#include <exceptions>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+GcObject::~GcObject() {
+  if (heap)
+    heap->untrack(this);
+}
+
+void trace_value(const std::any& value, const visit_t& visit) {
+  if (const array_t* array = std::any_cast<array_t>(&value))
+    visit(array->get());
+  else if (const map_t* map = std::any_cast<map_t>(&value))
+    visit(map->get());
+  else if (const CallableFunction* function = std::any_cast<CallableFunction>(&value))
+    visit(function->closure.get());
+  else if (const generator_t* generator = std::any_cast<generator_t>(&value))
+    visit(generator->get());
+}
+
+void GcObject::resize(size_t bytes) {
+  if (heap)
+    heap->resize(this, bytes);
+  else
+    size = bytes;
+}
+
+Heap::Heap(bool stress, size_t limit) : next_collection(initial_threshold), stress(stress), limit(limit) {}
+
+// whatever is still tracked outlives the heap through outside references
+Heap::~Heap() {
+  for (GcObject* object = objects; object; object = object->next)
+    object->heap = nullptr;
+}
+
+void Heap::track(GcObject* object, size_t size) {
+  object->heap = this;
+  object->size = size;
+  object->next = objects;
+  if (objects)
+    objects->prev = object;
+  objects = object;
+  ++count;
+  allocated += size;
+}
+
+void Heap::untrack(GcObject* object) {
+  if (object->prev)
+    object->prev->next = object->next;
+  else
+    objects = object->next;
+  if (object->next)
+    object->next->prev = object->prev;
+  --count;
+  allocated -= object->size;
+}
+
+void Heap::resize(GcObject* object, size_t bytes) {
+  allocated += bytes - object->size;
+  object->size = bytes;
+  if (limit && allocated > limit && !collecting)
+    enforce_limit(0);
+}
+
+void Heap::enforce_limit(size_t more) {
+  collect();
+  if (allocated + more > limit)
+    throw BudgetError("Heap limit exceeded.", nullptr);
+}
+
+void Heap::collect() {
+  if (collecting)
+    return;
+  collecting = true;
+  auto start = std::chrono::steady_clock::now();
+
+  // every reference from one tracked object to another cancels one owner,
+  // what remains is held from outside
+  for (GcObject* object = objects; object; object = object->next) {
+    object->gc_refs = object->weak_from_this().use_count();
+    object->marked = false;
+  }
+  for (GcObject* object = objects; object; object = object->next) {
+    object->trace([this](GcObject* child) {
+      if (child && child->heap == this)
+        --child->gc_refs;
+    });
+  }
+
+  // mark from the objects held from outside
+  std::vector<GcObject*> pending;
+  for (GcObject* object = objects; object; object = object->next) {
+    if (object->gc_refs > 0 && !object->marked) {
+      object->marked = true;
+      pending.push_back(object);
+    }
+  }
+  while (!pending.empty()) {
+    GcObject* object = pending.back();
+    pending.pop_back();
+    object->trace([&](GcObject* child) {
+      if (child && child->heap == this && !child->marked) {
+        child->marked = true;
+        pending.push_back(child);
+      }
+    });
+  }
+
+  // sweep: hold the garbage while clearing it so nothing is destroyed half
+  // way, then let the last references go
+  std::vector<std::shared_ptr<GcObject>> garbage;
+  size_t freed = 0;
+  for (GcObject* object = objects; object; object = object->next) {
+    if (!object->marked) {
+      garbage.push_back(object->shared_from_this());
+      freed += object->size;
+    }
+  }
+  for (const auto& object : garbage)
+    object->clear();
+  stats.objects_freed += garbage.size();
+  stats.bytes_freed += freed;
+  garbage.clear();
+
+  next_collection = std::max(initial_threshold, 2 * allocated);
+  double pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  ++stats.collections;
+  stats.pause_ms += pause;
+  stats.max_pause_ms = std::max(stats.max_pause_ms, pause);
+  collecting = false;
+}
+
+size_t Heap::bytes() const { return allocated; }
+size_t Heap::headroom() const { return !limit ? SIZE_MAX : limit > allocated ? limit - allocated : 0; }
+size_t Heap::objects_alive() const { return count; }
+const GcStats& Heap::statistics() const { return stats; }
\ No newline at end of file
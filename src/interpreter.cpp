@@ -1,26 +1,28 @@
 #include <interpreter>
 #include <iostream>
-#include <iomanip>
-#include <sstream>
+#include <chrono>
+#include <cmath>
 #include <callable-function>
+#include <native>
+#include <typed-array>
+#include <hash-map>
+#include <number>
+#include <machine-stack>
+#include <jit>
+#include <parser>
 #include <owo>
+#include <parallel>
+#include <generator>
+#include <file>
 
 bool is_string(const std::any& obj) {
   return obj.type() == typeid(std::string);
 }
 
-bool is_double(const std::any& obj) {
-  return obj.type() == typeid(double);
-}
-
 bool is_bool(const std::any& obj) {
   return obj.type() == typeid(bool);
 }
 
-double get_double(const std::any& obj) {
-  return std::any_cast<double>(obj);
-}
-
 std::string get_string(const std::any& obj) {
   return std::any_cast<std::string>(obj);
 }
@@ -29,40 +31,151 @@ bool get_bool(const std::any& obj) {
   return std::any_cast<bool>(obj);
 }
 
-std::string double_to_string(const double value) {
-  std::ostringstream oss;
-  oss << std::fixed << std::setprecision(15) << value;
-  std::string str_value = oss.str();
-
-  str_value.erase(str_value.find_last_not_of('0') + 1);
-  if (str_value.back() == '.')
-    str_value.pop_back();
-  return str_value;
-}
-
 std::any Interpreter::evaluate(Expr& expr) {
   return expr.accept(*this);
 }
 
 nullptr_t Interpreter::execute(Stmt& stmt) {
+  step(nullptr);
   stmt.accept(*this);
   return nullptr;
 }
 
 void Interpreter::interpret(const std::vector<std::unique_ptr<Stmt>> &stmts) {
-  try {
-    for (const auto& stmt : stmts)
-      execute(*stmt);
-  } catch (const RuntimeError& error) {
-    owo::runtime_error(error);
-  }
+  budget.start();
+  machine.run([&] {
+    try {
+      for (const auto& stmt : stmts)
+        execute(*stmt);
+    } catch (const RuntimeError& error) {
+      frames.clear();
+      session.runtime_error(error);
+    }
+  });
 }
 
 void Interpreter::set_mode(const int mode) { this->mode = mode; }
 
+// the memo table for calls to declaration, if it is memoized. the body
+// recurses through its own name, which must still mean this declaration
+MemoTable* Interpreter::memo_table(const Function& declaration, Environment* closure) {
+  if (!memoize)
+    return nullptr;
+
+  auto memo = memos.find(&declaration);
+  if (memo == memos.end())
+    memo = memos.emplace(&declaration, MemoTable::is_pure(declaration) ? std::make_unique<MemoTable>() : nullptr).first;
+  if (!memo->second)
+    return nullptr;
+
+  size_t hops;
+  const CallableFunction* self = std::any_cast<CallableFunction>(closure->lookup(declaration.name->lexeme, hops));
+  if (!self || &self->declaration != &declaration)
+    return nullptr;
+  return memo->second.get();
+}
+
+std::pair<size_t, size_t> Interpreter::memo_stats() const {
+  std::pair<size_t, size_t> stats{ 0, 0 };
+  for (const auto& [declaration, memo] : memos) {
+    if (!memo) continue;
+    stats.first += memo->hits;
+    stats.second += memo->misses;
+  }
+  return stats;
+}
+
+// runs the declaration's native code when it has (or just earned) some and
+// the call fits it: only numbers of one representation in, and the name the
+// body recurses through must still be bound to this declaration
+bool Interpreter::call_native(const Function& declaration, Environment* closure, Arguments arguments, std::any& result) {
+  // declarations from a snapshot weren't parsed, so their parameter count
+  // is checked again before it can overrun the buffer below
+  if (!jit || declaration.params.size() > Parser::max_args)
+    return false;
+
+  Function& function = const_cast<Function&>(declaration);
+  Specialization state = function.state.load(std::memory_order_acquire);
+
+  if (state == UNSPECIALIZED) {
+    if (function.calls.fetch_add(1, std::memory_order_relaxed) + 1 != jit_threshold)
+      return false;
+    native_fn code = Jit::compile(declaration);
+    integer_native_fn integer_code = Jit::compile_integer(declaration);
+    function.native.store(reinterpret_cast<void*>(code), std::memory_order_relaxed);
+    function.integer_native.store(reinterpret_cast<void*>(integer_code), std::memory_order_relaxed);
+    state = code || integer_code ? COMPILED : GENERIC;
+    function.state.store(state, std::memory_order_release);
+  }
+  if (state != COMPILED)
+    return false;
+
+  // both argument buffers alias one array of 8 byte slots
+  union { double reals[Parser::max_args]; int64_t integers[Parser::max_args]; } args;
+  bool integers = !arguments.size() || arguments[0].type() == typeid(int64_t);
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    if (integers) {
+      const int64_t* arg = std::any_cast<int64_t>(&arguments[i]);
+      if (!arg) return false;
+      args.integers[i] = *arg;
+    } else {
+      const double* arg = std::any_cast<double>(&arguments[i]);
+      if (!arg) return false;
+      args.reals[i] = *arg;
+    }
+  }
+
+  void* code = (integers ? function.integer_native : function.native).load(std::memory_order_relaxed);
+  if (!code)
+    return false;
+
+  size_t hops;
+  const CallableFunction* self = std::any_cast<CallableFunction>(closure->lookup(declaration.name->lexeme, hops));
+  if (!self || &self->declaration != &declaration)
+    return false;
+
+  // native frames count against the depth limit and are far smaller than
+  // the room reserved per frame, so running out of depth natively is the
+  // stack overflow the tree walker would have hit as well. this call is on
+  // frames already yet counts again on native entry, and the counter bails
+  // on reaching zero, hence the 2
+  JitContext ctx{ static_cast<int64_t>(max_depth - frames.size() + 2), JIT_DONE, budget.countdown, refuel, this };
+  if (integers)
+    result = reinterpret_cast<integer_native_fn>(code)(args.integers, &ctx);
+  else
+    result = reinterpret_cast<native_fn>(code)(args.reals, &ctx);
+  budget.countdown = ctx.fuel;
+
+  switch (ctx.bailed) {
+  case JIT_DEPTH:
+    if (frames.empty())
+      return false;
+    throw BudgetError("Stack overflow.", frames.back().call_site);
+  case JIT_NUMBER:
+    // the integer code keeps meeting values it would have to promote; the
+    // tree walker takes this call and every later one
+    function.integer_native.store(nullptr, std::memory_order_relaxed);
+    return false;
+  case JIT_FUEL:
+    over_budget(nullptr);
+    return false;
+  }
+  return true;
+}
+
+// a native call found the countdown spent
+bool Interpreter::refuel(JitContext* ctx) {
+  Interpreter& interpreter = *static_cast<Interpreter*>(ctx->owner);
+  interpreter.budget.countdown = ctx->fuel;
+  if (interpreter.budget.checkpoint())
+    return false;
+  ctx->fuel = interpreter.budget.countdown;
+  return true;
+}
+
 bool Interpreter::is_equal(const std::any& left, const std::any& right) {
-  if (is_double(left) && is_double(right))
-    return get_double(left) == get_double(right);
+  if (is_number(left) && is_number(right))
+    return number_equal(left, right);
 
   if (is_string(left) && is_string(right))
     return get_string(left) == get_string(right);
@@ -70,103 +183,269 @@ bool Interpreter::is_equal(const std::any& left, const std::any& right) {
   if (is_bool(left) && is_bool(right))
     return get_bool(left) == get_bool(right);
 
+  const array_t* left_array = std::any_cast<array_t>(&left);
+  const array_t* right_array = std::any_cast<array_t>(&right);
+  if (left_array && right_array)
+    return *left_array == *right_array;
+
+  const map_t* left_map = std::any_cast<map_t>(&left);
+  const map_t* right_map = std::any_cast<map_t>(&right);
+  if (left_map && right_map)
+    return *left_map == *right_map;
+
+  const file_t* left_file = std::any_cast<file_t>(&left);
+  const file_t* right_file = std::any_cast<file_t>(&right);
+  if (left_file && right_file)
+    return *left_file == *right_file;
+
+  const generator_t* left_generator = std::any_cast<generator_t>(&left);
+  const generator_t* right_generator = std::any_cast<generator_t>(&right);
+  if (left_generator && right_generator)
+    return *left_generator == *right_generator;
+
   return !is_truthy(left) && !is_truthy(right);
 }
 
 bool Interpreter::is_truthy(const std::any& obj) {
-  if (is_double(obj)) return get_double(obj) != 0.f;
+  if (const int64_t* integer = std::any_cast<int64_t>(&obj)) return *integer != 0;
+  if (const double* number = std::any_cast<double>(&obj)) return *number != 0.f;
   if (is_string(obj)) return get_string(obj).size() != 0;
   if (is_bool(obj)) return get_bool(obj);
+  if (const array_t* array = std::any_cast<array_t>(&obj)) return (*array)->size() != 0;
+  if (const map_t* map = std::any_cast<map_t>(&obj)) return (*map)->size() != 0;
   return false;
 }
 
 void Interpreter::check_number_operand(const Token* token, const std::any& op) {
-  if (is_double(op)) return;
+  if (is_number(op)) return;
   throw RuntimeError("Operand must be of type number", token);
 }
 
 void Interpreter::check_number_operands(const Token* token, const std::any& left, const std::any& right) {
-  if (is_double(left) && is_double(right)) return;
+  if (is_number(left) && is_number(right)) return;
   throw RuntimeError("Operands must be of type number", token);
 }
 
 void Interpreter::execute_block(const std::vector<std::unique_ptr<Stmt>>& stmts, Environment* env) {
   Environment* previous = this->env;
   this->env = env;
-  for (const auto& stmt : stmts)
-    execute(*stmt);
+  try {
+    for (const auto& stmt : stmts)
+      execute(*stmt);
+  } catch (...) {
+    this->env = previous;
+    throw;
+  }
   this->env = previous;
 }
 
-Interpreter::Interpreter() : env(new Environment) {
+// a file argument that can still be read from
+static File& readable(const file_t& file) {
+  if (!file->is_open())
+    throw RuntimeError("File '" + file->name() + "' is closed.", nullptr);
+  return *file;
+}
+
+// a count argument of the file natives
+static size_t count(int64_t n) {
+  if (n < 0)
+    throw RuntimeError("Count must not be negative.", nullptr);
+  return n;
+}
+
+Interpreter::Interpreter(owo& session)
+  : heap(session.options().gc_stress, session.options().max_heap), specialize(session.options().specialize), jit(session.options().jit && Jit::available()),
+    jit_threshold(session.options().jit_threshold), max_depth(session.options().max_depth),
+    memoize(session.options().memoize), session(session), machine(max_depth * frame_bytes),
+    budget(session.options().max_steps, session.options().timeout_ms), globals(heap.make<Environment>()), env(globals.get()), out(session.output()) {
   // make environment not take token itself
   // handle runtime error taking token elsewhere
   // maybe outside instead
 
-  env->define(
-    "print",
-    Callable("<native_fn>", 1, [=](Interpreter& interpreter, const std::vector<std::any>& arguments) {
-      for (const auto& arg : arguments)
-        std::cout << arg << std::endl;
-      return std::any(nullptr);
-    }),
-    nullptr
-  );
+  env->define("print", native<void(Interpreter&, const std::any&)>([](Interpreter& interpreter, const std::any& value) {
+    interpreter.out << value << std::endl;
+  }), nullptr);
+  env->define("clock", native<double()>([] {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }), nullptr);
+  env->define("sqrt", native<double(double)>([](double x) { return std::sqrt(x); }), nullptr);
+  env->define("floor", native<double(double)>([](double x) { return std::floor(x); }), nullptr);
+  env->define("memo_hits", native<int64_t(Interpreter&)>([](Interpreter& interpreter) {
+    return static_cast<int64_t>(interpreter.memo_stats().first);
+  }), nullptr);
+  env->define("memo_misses", native<int64_t(Interpreter&)>([](Interpreter& interpreter) {
+    return static_cast<int64_t>(interpreter.memo_stats().second);
+  }), nullptr);
+  env->define("inlined_sites", native<int64_t(Interpreter&)>([](Interpreter& interpreter) {
+    return static_cast<int64_t>(interpreter.inlined_sites());
+  }), nullptr);
+  env->define("len", native<int64_t(const std::any&)>([](const std::any& value) {
+    if (const array_t* array = std::any_cast<array_t>(&value))
+      return static_cast<int64_t>((*array)->size());
+    if (const map_t* map = std::any_cast<map_t>(&value))
+      return static_cast<int64_t>((*map)->size());
+    if (const std::string* string = std::any_cast<std::string>(&value))
+      return static_cast<int64_t>(string->size());
+    throw RuntimeError("Expected argument 1 to be an array, a map or a string.", nullptr);
+  }), nullptr);
+  env->define("has", native<bool(const map_t&, const std::any&)>([](const map_t& map, const std::any& key) {
+    uint64_t hash;
+    return HashMap::hash(key, hash) && map->get(key, hash);
+  }), nullptr);
+  env->define("delete", native<bool(const map_t&, const std::any&)>([](const map_t& map, const std::any& key) {
+    uint64_t hash;
+    return HashMap::hash(key, hash) && map->remove(key, hash);
+  }), nullptr);
+  // iteration: arrays of the keys or values, in insertion order
+  env->define("keys", native<array_t(Interpreter&, const map_t&)>([](Interpreter& interpreter, const map_t& map) {
+    array_t keys = interpreter.heap.make<Array>();
+    map->each([&](const std::any& key, const std::any&) { keys->push(key); });
+    return keys;
+  }), nullptr);
+  env->define("values", native<array_t(Interpreter&, const map_t&)>([](Interpreter& interpreter, const map_t& map) {
+    array_t values = interpreter.heap.make<Array>();
+    map->each([&](const std::any&, const std::any& value) { values->push(value); });
+    return values;
+  }), nullptr);
+  env->define("push", native<void(const array_t&, const std::any&)>([](const array_t& array, const std::any& value) {
+    array->push(value);
+  }), nullptr);
+  env->define("pop", native<std::any(const array_t&)>([](const array_t& array) {
+    if (!array->size())
+      throw RuntimeError("Can't pop from an empty array.", nullptr);
+    return array->pop();
+  }), nullptr);
+  env->define("gc", native<void(Interpreter&)>([](Interpreter& interpreter) {
+    interpreter.heap.collect();
+  }), nullptr);
+  env->define("gc_stats", native<map_t(Interpreter&)>([](Interpreter& interpreter) {
+    const GcStats& stats = interpreter.heap.statistics();
+    map_t map = interpreter.heap.make<HashMap>();
+    auto set = [&](const std::string& key, const std::any& value) {
+      uint64_t hash;
+      HashMap::hash(key, hash);
+      map->set(key, hash, value);
+    };
+    set("collections", static_cast<int64_t>(stats.collections));
+    set("pause_ms", stats.pause_ms);
+    set("max_pause_ms", stats.max_pause_ms);
+    set("objects_freed", static_cast<int64_t>(stats.objects_freed));
+    set("bytes_freed", static_cast<int64_t>(stats.bytes_freed));
+    set("heap_objects", static_cast<int64_t>(interpreter.heap.objects_alive()));
+    set("heap_bytes", static_cast<int64_t>(interpreter.heap.bytes()));
+    return map;
+  }), nullptr);
+  env->define("pow", native<double(double, double)>([](double x, double y) { return std::pow(x, y); }), nullptr);
+  // data parallelism for pure functions, see Parallel
+  env->define("pmap", native<array_t(Interpreter&, const array_t&, const std::any&)>([](Interpreter& interpreter, const array_t& items, const std::any& function) {
+    return interpreter.parallel().map(interpreter, function, *items);
+  }), nullptr);
+  env->define("preduce", native<std::any(Interpreter&, const array_t&, const std::any&, const std::any&)>([](Interpreter& interpreter, const array_t& items, const std::any& function, const std::any& initial) {
+    return interpreter.parallel().reduce(interpreter, function, *items, initial);
+  }), nullptr);
+  // lazy sequences, see Generator
+  env->define("generator", native<generator_t(Interpreter&, const std::any&)>([](Interpreter& interpreter, const std::any& function) {
+    const CallableFunction* callable = std::any_cast<CallableFunction>(&function);
+    if (!callable || callable->arity() != 0)
+      throw RuntimeError("Generators take a function of no arguments.", nullptr);
+    return interpreter.heap.make<Generator>(interpreter, function, interpreter.max_depth * frame_bytes);
+  }), nullptr);
+  env->define("next", native<std::any(const generator_t&)>([](const generator_t& generator) {
+    return generator->next();
+  }), nullptr);
+  env->define("done", native<bool(const generator_t&)>([](const generator_t& generator) {
+    return generator->done();
+  }), nullptr);
+  // files are read front to back, a line or a few bytes at a time, see File
+  env->define("open", native<file_t(Interpreter&, const std::string&)>([](Interpreter& interpreter, const std::string& path) {
+    if (!interpreter.session.options().allow_files)
+      throw RuntimeError("Files are disabled, see --allow-files.", nullptr);
+    return File::open(path);
+  }), nullptr);
+  env->define("read_line", native<std::any(const file_t&)>([](const file_t& file) -> std::any {
+    std::string line;
+    if (!readable(file).read_line(line)) return nullptr;
+    return line;
+  }), nullptr);
+  // up to n lines at once, so scripts can stay shallow over long files
+  env->define("read_lines", native<array_t(Interpreter&, const file_t&, int64_t)>([](Interpreter& interpreter, const file_t& file, int64_t n) {
+    File& from = readable(file);
+    array_t lines = interpreter.heap.make<Array>();
+    std::string line;
+    for (size_t left = count(n); left && from.read_line(line); --left) {
+      lines->push(std::move(line));
+      line.clear();
+    }
+    return lines;
+  }), nullptr);
+  env->define("read", native<std::any(const file_t&, int64_t)>([](const file_t& file, int64_t n) -> std::any {
+    std::string bytes;
+    if (!readable(file).read(count(n), bytes)) return nullptr;
+    return bytes;
+  }), nullptr);
+  env->define("close", native<void(const file_t&)>([](const file_t& file) {
+    file->close();
+  }), nullptr);
 }
 
+// values held outside the heap go first, so the final collection sees the
+// global environment's cycles as garbage
 Interpreter::~Interpreter() {
-  delete env;
+  workers.reset();
+  while (!suspended.empty())
+    (*suspended.begin())->cancel();
+  memos.clear();
+  stack.clear();
+  globals.reset();
+  heap.collect();
 }
 
 void Interpreter::visitBinaryExpr(Binary &expr) {
   std::any left = evaluate(*expr.left);
   std::any right = evaluate(*expr.right);
 
+  // a node that has only seen numbers skips the type probing below; the
+  // first non-number it sees deoptimizes it to GENERIC for good
+  Specialization state = expr.state.load(std::memory_order_relaxed);
+  if (specialize && state != GENERIC) {
+    if (is_number(left) && is_number(right)) {
+      if (state == UNSPECIALIZED)
+        expr.state.store(NUMERIC, std::memory_order_relaxed);
+      result_expr = number_binary(expr.op->type, left, right, expr.op);
+      return;
+    }
+    expr.state.store(GENERIC, std::memory_order_relaxed);
+  }
+
   switch (expr.op->type) {
   case TokenType::PLUS:
     if (is_string(left) && is_string(right)) {
       result_expr = get_string(left) + get_string(right);
-    } else if (is_double(left) && is_double(right)) {
-      result_expr = get_double(left) + get_double(right);
-    } else if (is_string(left) && is_double(right)) {
-      result_expr = get_string(left) + double_to_string(get_double(right));
-    } else if (is_double(left) && is_string(right)) {
-      result_expr = double_to_string(get_double(left)) + get_string(right);
+    } else if (is_number(left) && is_number(right)) {
+      result_expr = number_binary(expr.op->type, left, right, expr.op);
+    } else if (is_string(left) && is_number(right)) {
+      result_expr = get_string(left) + number_to_string(right);
+    } else if (is_number(left) && is_string(right)) {
+      result_expr = number_to_string(left) + get_string(right);
     } else {
       throw RuntimeError("Operands must be of type number and/or string", expr.op);
     }
     return;
   case TokenType::MINUS:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) - get_double(right);
-    return;
   case TokenType::STAR:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) * get_double(right);
-    return;
   case TokenType::SLASH:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) / get_double(right);
-    return;
   case TokenType::PERCENTAGE:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) % (int)get_double(right));
-    return;
   case TokenType::GREATER:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) > get_double(right);
-    return;
   case TokenType::GREATER_EQUAL:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) >= get_double(right);
-    return;
   case TokenType::LESS:
-    check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) < get_double(right);
-    return;
   case TokenType::LESS_EQUAL:
+  case TokenType::AND:
+  case TokenType::OR:
+  case TokenType::XOR:
+  case TokenType::LEFT_SHIFT:
+  case TokenType::RIGHT_SHIFT:
     check_number_operands(expr.op, left, right);
-    result_expr = get_double(left) <= get_double(right);
+    result_expr = number_binary(expr.op->type, left, right, expr.op);
     return;
   case TokenType::EQUAL_EQUAL:
     result_expr = is_equal(left, right);
@@ -174,26 +453,6 @@ void Interpreter::visitBinaryExpr(Binary &expr) {
   case TokenType::BANG_EQUAL:
     result_expr = !is_equal(left, right);
     return;
-  case TokenType::AND:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) & (int)get_double(right));
-    return;
-  case TokenType::OR:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) | (int)get_double(right));
-    return;
-  case TokenType::XOR:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) ^ (int)get_double(right));
-    return;
-  case TokenType::LEFT_SHIFT:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) << (int)get_double(right));
-    return;
-  case TokenType::RIGHT_SHIFT:
-    check_number_operands(expr.op, left, right);
-    result_expr = static_cast<double>((int)get_double(left) >> (int)get_double(right));
-    return;
   case TokenType::AND_AND:
     result_expr = !is_truthy(left) ? false : is_truthy(right);
     return;
@@ -223,47 +482,296 @@ void Interpreter::visitUnaryExpr(Unary &expr) {
   switch (expr.op->type) {
   case TokenType::MINUS:
     check_number_operand(expr.op, right);
-    result_expr = -get_double(right);
+    result_expr = number_negate(right);
     return;
   case TokenType::BANG:
     result_expr = !is_truthy(right);
     return;
   case TokenType::NOT:
     check_number_operand(expr.op, right);
-    result_expr = static_cast<double>(~(int)get_double(right));
+    result_expr = number_not(right, expr.op);
     return;
   }
 
   result_expr = nullptr;
 }
 
+// drops a call's arguments from the value stack however the call ends
+struct StackMark {
+  std::vector<std::any>& stack;
+  const size_t base;
+  ~StackMark() { stack.resize(base); }
+};
+
+// pops the frame pushed for a call however the call ends
+struct FrameMark {
+  std::vector<Frame>& frames;
+  ~FrameMark() { frames.pop_back(); }
+};
+
+std::any Interpreter::call(std::any callee, const std::vector<std::any>& args) {
+  std::any result;
+  machine.run([&] {
+    StackMark mark{ stack, stack.size() };
+    for (const std::any& arg : args)
+      stack.push_back(arg);
+    Arguments arguments(stack, mark.base, args.size());
+
+    const CallableFunction* function = std::any_cast<CallableFunction>(&callee);
+    const Callable* native = function ? nullptr : std::any_cast<Callable>(&callee);
+    if (!function && !native)
+      throw RuntimeError("Can only call functions and classes.", nullptr);
+    size_t arity = function ? function->declaration.params.size() : native->arity();
+    if (args.size() != arity)
+      throw RuntimeError("Expected " + std::to_string(arity) + " arguments but got " + std::to_string(args.size()) + ".", nullptr);
+
+    if (native) {
+      Callable copy = *native;
+      result = copy.call(*this, arguments);
+      return;
+    }
+    push_frame(function->declaration, nullptr);
+    FrameMark frame{ frames };
+    result = CallableFunction::invoke(*this, function->declaration, function->closure, arguments);
+  });
+  return result;
+}
+
+Parallel& Interpreter::parallel() {
+  if (!workers)
+    workers = std::make_unique<Parallel>(session.options());
+  return *workers;
+}
+
+void Interpreter::swap(Strand& strand) {
+  std::swap(env, strand.env);
+  stack.swap(strand.stack);
+  frames.swap(strand.frames);
+  std::swap(inlining, strand.inlining);
+  std::swap(inline_base, strand.inline_base);
+  std::swap(inline_depth, strand.inline_depth);
+  std::swap(generator, strand.generator);
+}
+
+void Interpreter::push_frame(const Function& function, const Token* call_site) {
+  if (frames.size() >= max_depth || (generator ? generator->exhausted() : machine.exhausted()))
+    throw BudgetError("Stack overflow.", call_site);
+  frames.push_back({ &function, call_site });
+}
+
+// statements have no token, so the innermost call site is blamed for them
+void Interpreter::over_budget(const Token* token) {
+  if (const char* message = budget.checkpoint())
+    throw BudgetError(message, token || frames.empty() ? token : frames.back().call_site);
+}
+
+// the heap limit is hit without a token at hand, the innermost call gets
+// the blame
+[[noreturn]] static void blame(const BudgetError& error, const Token* call_site) {
+  if (error.token) throw;
+  throw BudgetError(error.what(), call_site);
+}
+
 void Interpreter::visitCallExpr(Call &expr) {
+  step(expr.paren);
+  StackMark mark{ stack, stack.size() };
+
+  // known callee: the variable still holds the declaration this site was
+  // specialized to, so arity is already checked and no Callable is copied
+  Specialization state = expr.state.load(std::memory_order_relaxed);
+  if (state == MONOMORPHIC || state == INLINED) {
+    const CallableFunction* function = std::any_cast<CallableFunction>(lookup(static_cast<Variable&>(*expr.callee)));
+    if (function && &function->declaration == expr.target.load(std::memory_order_relaxed)) {
+      const Function& declaration = function->declaration;
+      // a call can rebind the variable, the site keeps its own reference
+      std::shared_ptr<Environment> closure = function->closure;
+
+      if (const InlineBody* body = inline_body(declaration)) {
+        Specialization expected = MONOMORPHIC;
+        if (state == MONOMORPHIC && expr.state.compare_exchange_strong(expected, INLINED, std::memory_order_relaxed))
+          ++inlined;
+        for (const auto& arg : expr.args)
+          stack.push_back(evaluate(*arg));
+        result_expr = inline_call(*body, closure, mark.base);
+        return;
+      }
+
+      for (const auto& arg : expr.args)
+        stack.push_back(evaluate(*arg));
+      push_frame(declaration, expr.paren);
+      FrameMark frame{ frames };
+      try {
+        result_expr = CallableFunction::invoke(*this, declaration, closure, Arguments(stack, mark.base, expr.args.size()));
+      } catch (const BudgetError& error) {
+        blame(error, expr.paren);
+      }
+      return;
+    }
+    expr.state.store(GENERIC, std::memory_order_relaxed);
+  }
+
   std::any callee = evaluate(*expr.callee);
 
-  std::vector<std::any> arguments;
   for (const auto& arg : expr.args)
-    arguments.push_back(evaluate(*arg));
+    stack.push_back(evaluate(*arg));
+  Arguments arguments(stack, mark.base, expr.args.size());
+
+  if (Callable* func = std::any_cast<Callable>(&callee)) {
+    if (arguments.size() != func->arity())
+      throw RuntimeError("Expected " + std::to_string(func->arity()) + " arguments but got " + std::to_string(arguments.size()) + ".", expr.paren);
+    // natives have no token of their own to blame
+    try {
+      result_expr = func->call(*this, arguments);
+    } catch (const BudgetError& error) {
+      blame(error, expr.paren);
+    } catch (const RuntimeError& error) {
+      if (error.token) throw;
+      throw RuntimeError(error.what(), expr.paren);
+    }
 
-  if (callee.type() == typeid(Callable)) {
-    Callable func = std::any_cast<Callable>(callee);
-    if (arguments.size() != func.arity())
-      throw RuntimeError("Expected " + std::to_string(func.arity()) + " arguments but got " + std::to_string(arguments.size()) + ".", expr.paren);
-    result_expr = func.call(*this, arguments);
+  } else if (CallableFunction* func = std::any_cast<CallableFunction>(&callee)) {
+    if (arguments.size() != func->arity())
+      throw RuntimeError("Expected " + std::to_string(func->arity()) + " arguments but got " + std::to_string(arguments.size()) + ".", expr.paren);
 
-  } else if (callee.type() == typeid(CallableFunction)) {
-    CallableFunction func = std::any_cast<CallableFunction>(callee);
-    if (arguments.size() != func.arity())
-      throw RuntimeError("Expected " + std::to_string(func.arity()) + " arguments but got " + std::to_string(arguments.size()) + ".", expr.paren);
-      result_expr = func.call(*this, arguments);
-      // std::cout << std::endl;//temp
+    if (specialize && expr.state.load(std::memory_order_relaxed) == UNSPECIALIZED && typeid(*expr.callee) == typeid(Variable)) {
+      expr.target.store(&func->declaration, std::memory_order_relaxed);
+      expr.state.store(MONOMORPHIC, std::memory_order_relaxed);
+    }
+    push_frame(func->declaration, expr.paren);
+    FrameMark frame{ frames };
+    try {
+      result_expr = func->call(*this, arguments);
+    } catch (const BudgetError& error) {
+      blame(error, expr.paren);
+    }
 
   } else {
     throw RuntimeError("Can only call functions and classes.", expr.paren);
   }
 }
 
+// bodies worth inlining stay under this many nodes
+static const size_t inline_budget = 16;
+
+// whether expr fits an inlined body, collecting its parameter reads. calls
+// are fine as long as they are not through a parameter or back to the
+// function itself
+static bool inlinable(Expr* expr, const Function& function, InlineBody& body, size_t& budget) {
+  if (!expr || budget-- == 0) return false;
+
+  auto param = [&](const Token* name) -> long {
+    for (size_t i = 0; i < function.params.size(); ++i)
+      if (function.params[i]->lexeme == name->lexeme) return static_cast<long>(i);
+    return -1;
+  };
+
+  if (dynamic_cast<Literal*>(expr)) return true;
+  if (auto* grouping = dynamic_cast<Grouping*>(expr))
+    return inlinable(grouping->expression.get(), function, body, budget);
+  if (auto* unary = dynamic_cast<Unary*>(expr))
+    return inlinable(unary->right.get(), function, body, budget);
+  if (auto* binary = dynamic_cast<Binary*>(expr))
+    return inlinable(binary->left.get(), function, body, budget) && inlinable(binary->right.get(), function, body, budget);
+  if (auto* ternary = dynamic_cast<Ternary*>(expr))
+    return inlinable(ternary->condition.get(), function, body, budget)
+      && inlinable(ternary->true_case.get(), function, body, budget)
+      && inlinable(ternary->false_case.get(), function, body, budget);
+  if (auto* variable = dynamic_cast<Variable*>(expr)) {
+    long index = param(variable->label);
+    if (index >= 0) body.params.emplace(variable, static_cast<size_t>(index));
+    return true;
+  }
+  if (auto* call = dynamic_cast<Call*>(expr)) {
+    auto* callee = dynamic_cast<Variable*>(call->callee.get());
+    if (!callee || param(callee->label) >= 0 || callee->label->lexeme == function.name->lexeme) return false;
+    for (const auto& arg : call->args)
+      if (!inlinable(arg.get(), function, body, budget)) return false;
+    return true;
+  }
+  return false;
+}
+
+const InlineBody* Interpreter::inline_body(const Function& declaration) {
+  auto found = inlines.find(&declaration);
+  if (found != inlines.end())
+    return found->second.get();
+
+  std::unique_ptr<InlineBody> body;
+  const auto& stmts = Parser::body(declaration);
+  const Return* ret = stmts.size() == 1 ? dynamic_cast<const Return*>(stmts[0].get()) : nullptr;
+  size_t budget = inline_budget;
+  if (specialize && ret && ret->value) {
+    body = std::make_unique<InlineBody>();
+    body->value = ret->value.get();
+    if (!inlinable(body->value, declaration, *body, budget))
+      body = nullptr;
+  }
+  return inlines.emplace(&declaration, std::move(body)).first->second.get();
+}
+
+// evaluates an inlined body for arguments on the value stack from base on.
+// free names resolve from an empty scope under the closure, the same number
+// of hops away as from the environment a real call would create
+std::any Interpreter::inline_call(const InlineBody& body, const std::shared_ptr<Environment>& closure, size_t base) {
+  struct Restore {
+    Interpreter& interpreter;
+    Environment* env = interpreter.env;
+    const InlineBody* inlining = interpreter.inlining;
+    size_t base = interpreter.inline_base;
+    size_t depth = interpreter.inline_depth;
+    ~Restore() {
+      interpreter.env = env;
+      interpreter.inlining = inlining;
+      interpreter.inline_base = base;
+      interpreter.inline_depth = depth;
+    }
+  } restore{ *this };
+
+  Environment scope(closure);
+  env = &scope;
+  inlining = &body;
+  inline_base = base;
+  inline_depth = frames.size();
+  return evaluate(*body.value);
+}
+
+size_t Interpreter::inlined_sites() const { return inlined; }
+
+// resolves a variable, remembering how many environments up it was found.
+// the hop count stays valid until a captured environment gains a name
+std::any* Interpreter::lookup(Variable& expr) {
+  const std::string& name = expr.label->lexeme;
+
+  if (specialize) {
+    uint64_t slot = expr.slot.load(std::memory_order_relaxed);
+    if (slot && (slot >> 16) == Environment::epoch.load(std::memory_order_relaxed)) {
+      if (Environment* target = env->ancestor((slot & 0xFFFF) - 1)) {
+        if (std::any* value = target->find(name))
+          return value;
+      }
+    }
+  }
+
+  uint64_t epoch = Environment::epoch.load(std::memory_order_relaxed);
+  size_t hops;
+  std::any* value = env->lookup(name, hops);
+  if (!value)
+    throw RuntimeError("Undefined variable '" + name + "'.", expr.label);
+
+  if (specialize && hops < 0xFFFF)
+    expr.slot.store((epoch << 16) | (hops + 1), std::memory_order_relaxed);
+  return value;
+}
+
 void Interpreter::visitVariableExpr(Variable &expr) {
-  result_expr = env->get(expr.label->lexeme, expr.label);
+  if (inlining && frames.size() == inline_depth) {
+    auto param = inlining->params.find(&expr);
+    if (param != inlining->params.end()) {
+      result_expr = stack[inline_base + param->second];
+      return;
+    }
+  }
+  result_expr = *lookup(expr);
 }
 
 void Interpreter::visitTernaryExpr(Ternary &expr) {
@@ -271,11 +779,76 @@ void Interpreter::visitTernaryExpr(Ternary &expr) {
   result_expr = evaluate(is_truthy(condition) ? *expr.true_case : *expr.false_case);
 }
 
+void Interpreter::visitArrayLiteralExpr(ArrayLiteral& expr) {
+  array_t array = heap.make<Array>();
+  for (const auto& element : expr.elements)
+    array->push(evaluate(*element));
+  result_expr = array;
+}
+
+size_t Interpreter::check_index(const Token* token, const std::any& index, size_t size) {
+  int64_t number;
+  if (!is_number(index) || !exact_integer(index, number) || number < 0)
+    throw RuntimeError("Index must be a non-negative integer.", token);
+  if (static_cast<uint64_t>(number) >= size)
+    throw RuntimeError("Index " + std::to_string(number) + " out of range for length " + std::to_string(size) + ".", token);
+  return static_cast<size_t>(number);
+}
+
+uint64_t Interpreter::check_key(const Token* token, const std::any& key) {
+  uint64_t hash;
+  if (!HashMap::hash(key, hash))
+    throw RuntimeError("Map keys must be strings or numbers other than NaN.", token);
+  return hash;
+}
+
+void Interpreter::visitMapLiteralExpr(MapLiteral& expr) {
+  map_t map = heap.make<HashMap>();
+  for (const auto& [key_expr, value_expr] : expr.entries) {
+    std::any key = evaluate(*key_expr);
+    uint64_t hash = check_key(expr.brace, key);
+    map->set(key, hash, evaluate(*value_expr));
+  }
+  result_expr = map;
+}
+
+void Interpreter::visitIndexExpr(Index& expr) {
+  std::any object = evaluate(*expr.object);
+  std::any index = evaluate(*expr.index);
+
+  if (const array_t* array = std::any_cast<array_t>(&object)) {
+    result_expr = (*array)->get(check_index(expr.bracket, index, (*array)->size()));
+  } else if (const map_t* map = std::any_cast<map_t>(&object)) {
+    // missing keys read as nil
+    const std::any* value = (*map)->get(index, check_key(expr.bracket, index));
+    result_expr = value ? *value : std::any(nullptr);
+  } else if (const std::string* string = std::any_cast<std::string>(&object)) {
+    result_expr = std::string(1, (*string)[check_index(expr.bracket, index, string->size())]);
+  } else {
+    throw RuntimeError("Only arrays, maps and strings can be indexed.", expr.bracket);
+  }
+}
+
+void Interpreter::visitIndexAssignExpr(IndexAssign& expr) {
+  Index& target = static_cast<Index&>(*expr.target);
+  std::any object = evaluate(*target.object);
+  std::any index = evaluate(*target.index);
+  std::any value = evaluate(*expr.value);
+
+  if (const array_t* array = std::any_cast<array_t>(&object))
+    (*array)->set(check_index(target.bracket, index, (*array)->size()), value);
+  else if (const map_t* map = std::any_cast<map_t>(&object))
+    (*map)->set(index, check_key(target.bracket, index), value);
+  else
+    throw RuntimeError("Only array elements and map entries can be assigned.", target.bracket);
+  result_expr = value;
+}
+
 void Interpreter::visitExpressionStmt(Expression &stmt) {
   for (const auto& expr : stmt.expressions) {
     std::any value = evaluate(*expr);
     if (mode == 1)
-      std::cout << value << std::endl;
+      out << value << std::endl;
   }
 }
 
@@ -285,23 +858,67 @@ void Interpreter::visitVarStmt(Var &stmt) {
 }
 
 void Interpreter::visitBlockStmt(Block &stmt) {
-  Environment* new_env = new Environment(this->env);
-  execute_block(stmt.statements, new_env);
-  delete new_env;
+  std::shared_ptr<Environment> scope = heap.make<Environment>(std::static_pointer_cast<Environment>(env->shared_from_this()));
+  execute_block(stmt.statements, scope.get());
 }
 
 void Interpreter::visitIfStmt(If &stmt) {
-  if (is_truthy(evaluate(*stmt.condition)))
+  Specialization state = specialize ? stmt.state.load(std::memory_order_relaxed) : GENERIC;
+  bool condition;
+
+  switch (state) {
+  case CONSTANT_TRUE:
+    condition = true;
+    break;
+  case CONSTANT_FALSE:
+    condition = false;
+    break;
+  case UNSPECIALIZED: {
+    const Expr* expr = stmt.condition.get();
+    while (auto* group = dynamic_cast<const Grouping*>(expr))
+      expr = group->expression.get();
+    if (auto* literal = dynamic_cast<const Literal*>(expr)) {
+      condition = is_truthy(literal->value);
+      stmt.state.store(condition ? CONSTANT_TRUE : CONSTANT_FALSE, std::memory_order_relaxed);
+      break;
+    }
+
+    std::any value = evaluate(*stmt.condition);
+    stmt.state.store(is_bool(value) ? BOOLEAN : GENERIC, std::memory_order_relaxed);
+    condition = is_truthy(value);
+    break;
+  }
+  case BOOLEAN: {
+    std::any value = evaluate(*stmt.condition);
+    if (const bool* b = std::any_cast<bool>(&value)) {
+      condition = *b;
+      break;
+    }
+    stmt.state.store(GENERIC, std::memory_order_relaxed);
+    condition = is_truthy(value);
+    break;
+  }
+  default:
+    condition = is_truthy(evaluate(*stmt.condition));
+  }
+
+  if (condition)
     execute(*stmt.if_case);
   else if (stmt.else_case)
     execute(*stmt.else_case);
 }
 
 void Interpreter::visitFunctionStmt(Function &stmt) {
-  CallableFunction function = CallableFunction(stmt);
+  CallableFunction function = CallableFunction(stmt, std::static_pointer_cast<Environment>(env->shared_from_this()));
   env->define(stmt.name->lexeme, function, stmt.name);
 }
 
 void Interpreter::visitReturnStmt(Return &stmt) {
   throw ReturnException(evaluate(*stmt.value));
 }
+
+void Interpreter::visitYieldStmt(Yield &stmt) {
+  if (!generator)
+    throw RuntimeError("Can't yield outside a generator.", stmt.keyword);
+  generator->yield(stmt.value ? evaluate(*stmt.value) : nullptr);
+}
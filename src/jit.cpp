@@ -0,0 +1,479 @@
+#include <jit>
+#include <parser>
+#include <number>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define OWO_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef OWO_JIT
+
+enum JitType { JIT_INTEGER, JIT_REAL, JIT_BOOL };
+
+// byte emitter with forward jump patching
+class Emitter {
+public:
+  std::vector<uint8_t> code;
+
+  void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+  void emit32(int32_t value) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    code.insert(code.end(), bytes, bytes + 4);
+  }
+
+  void emit64(uint64_t value) {
+    uint8_t bytes[8];
+    std::memcpy(bytes, &value, 8);
+    code.insert(code.end(), bytes, bytes + 8);
+  }
+
+  // emits a rel32 jump/call and returns the offset of its displacement
+  size_t jump(std::initializer_list<uint8_t> opcode) {
+    emit(opcode);
+    emit32(0);
+    return code.size() - 4;
+  }
+
+  void bind(size_t patch, size_t target) {
+    int32_t rel = static_cast<int32_t>(target - (patch + 4));
+    std::memcpy(&code[patch], &rel, 4);
+  }
+
+  void bind(size_t patch) { bind(patch, code.size()); }
+};
+
+static const uint8_t OFF_DEPTH = offsetof(JitContext, depth_left);
+static const uint8_t OFF_BAILED = offsetof(JitContext, bailed);
+static const uint8_t OFF_FUEL = offsetof(JitContext, fuel);
+static const uint8_t OFF_REFUEL = offsetof(JitContext, refuel);
+
+class Compiler {
+private:
+  const Function& function;
+  // representation of the parameters and of every value returned
+  const JitType number;
+  std::map<std::string, size_t> params;
+  Emitter e;
+  std::vector<size_t> to_epilogue;
+  std::vector<size_t> to_entry;
+  std::vector<size_t> to_promote;
+
+  static const Expr* strip(const Expr* expr) {
+    while (auto* group = dynamic_cast<const Grouping*>(expr))
+      expr = group->expression.get();
+    return expr;
+  }
+
+  bool is_self_call(const Call* call) {
+    auto* callee = dynamic_cast<const Variable*>(strip(call->callee.get()));
+    return callee && callee->label->lexeme == function.name->lexeme
+      && !params.count(callee->label->lexeme) && call->args.size() == function.params.size();
+  }
+
+  static bool numeric(JitType type) { return type != JIT_BOOL; }
+
+  // type check of the supported subset; false means leave it to the
+  // interpreter. in double code an integer may only be a literal operand
+  // next to a double, where the interpreter promotes it as well. it has to
+  // convert exactly: == compares an integer with a double exactly, and a
+  // rounded literal could equal a double the integer doesn't
+  bool check(const Expr* expr, JitType& type) {
+    expr = strip(expr);
+
+    if (auto* literal = dynamic_cast<const Literal*>(expr)) {
+      if (literal->value.type() == typeid(bool)) type = JIT_BOOL;
+      else if (literal->value.type() == typeid(int64_t)) type = JIT_INTEGER;
+      else if (literal->value.type() == typeid(double)) type = JIT_REAL;
+      else return false;
+      if (number == JIT_REAL && type == JIT_INTEGER) {
+        int64_t value = std::any_cast<int64_t>(literal->value), exact;
+        return exact_integer(static_cast<double>(value), exact) && exact == value;
+      }
+      return number == JIT_REAL || type != JIT_REAL;
+    }
+    if (auto* variable = dynamic_cast<const Variable*>(expr)) {
+      type = number;
+      return params.count(variable->label->lexeme);
+    }
+    if (auto* unary = dynamic_cast<const Unary*>(expr)) {
+      JitType right;
+      if (!check(unary->right.get(), right)) return false;
+      switch (unary->op->type) {
+      // a negated integer is an integer in the interpreter: -0 is 0, which
+      // double code would make -0.0
+      case MINUS: type = right; return numeric(right) && (number == JIT_INTEGER || right == JIT_REAL);
+      case NOT: type = right; return number == JIT_INTEGER && right == JIT_INTEGER;
+      case BANG: type = JIT_BOOL; return true;
+      default: return false;
+      }
+    }
+    if (auto* binary = dynamic_cast<const Binary*>(expr)) {
+      JitType left, right;
+      if (!check(binary->left.get(), left) || !check(binary->right.get(), right)) return false;
+      if (!numeric(left) || !numeric(right)) return false;
+      switch (binary->op->type) {
+      case PLUS: case MINUS: case STAR: case SLASH:
+        type = number;
+        return number == JIT_INTEGER || left == JIT_REAL || right == JIT_REAL;
+      case PERCENTAGE: case AND: case OR: case XOR: case LEFT_SHIFT: case RIGHT_SHIFT:
+        type = JIT_INTEGER;
+        return number == JIT_INTEGER;
+      case LESS: case LESS_EQUAL: case GREATER: case GREATER_EQUAL: case EQUAL_EQUAL: case BANG_EQUAL:
+        type = JIT_BOOL;
+        return true;
+      default:
+        return false;
+      }
+    }
+    if (auto* ternary = dynamic_cast<const Ternary*>(expr)) {
+      JitType condition, true_case, false_case;
+      type = number;
+      return check(ternary->condition.get(), condition) && check(ternary->true_case.get(), true_case)
+        && check(ternary->false_case.get(), false_case) && true_case == number && false_case == number;
+    }
+    if (auto* call = dynamic_cast<const Call*>(expr)) {
+      type = number;
+      if (!is_self_call(call)) return false;
+      for (const auto& arg : call->args) {
+        JitType arg_type;
+        if (!check(arg.get(), arg_type) || arg_type != number) return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  // true when every path through the statement ends in a return
+  bool check(const Stmt* stmt) {
+    if (auto* ret = dynamic_cast<const Return*>(stmt)) {
+      JitType type;
+      return ret->value && check(ret->value.get(), type) && type == number;
+    }
+    if (auto* branch = dynamic_cast<const If*>(stmt)) {
+      JitType type;
+      return branch->else_case && check(branch->condition.get(), type)
+        && check(branch->if_case.get()) && check(branch->else_case.get());
+    }
+    if (auto* block = dynamic_cast<const Block*>(stmt))
+      return check(block->statements);
+    return false;
+  }
+
+  // a body may open with ifs that return on one side, like 'if (n <= 1) return n;'
+  bool check(const std::vector<std::unique_ptr<Stmt>>& stmts) {
+    if (stmts.empty()) return false;
+    for (size_t i = 0; i + 1 < stmts.size(); ++i) {
+      auto* branch = dynamic_cast<const If*>(stmts[i].get());
+      JitType type;
+      if (!branch || branch->else_case || !check(branch->condition.get(), type) || !check(branch->if_case.get()))
+        return false;
+    }
+    return check(stmts.back().get());
+  }
+
+  // double code keeps values in xmm0, integer code in rax
+
+  void push() {
+    if (number == JIT_INTEGER) e.emit({ 0x50 });
+    else { e.emit({ 0x48, 0x81, 0xEC }); e.emit32(16); e.emit({ 0xF2, 0x0F, 0x11, 0x04, 0x24 }); }
+  }
+  // right operand in xmm1 (rcx), left restored to xmm0 (rax)
+  void pop_left() {
+    if (number == JIT_INTEGER) e.emit({ 0x48, 0x89, 0xC1, 0x58 });
+    else { e.emit({ 0x66, 0x0F, 0x28, 0xC8, 0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x81, 0xC4 }); e.emit32(16); }
+  }
+  void load_constant(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, 8);
+    e.emit({ 0x48, 0xB8 }); e.emit64(bits);
+    e.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC0 });
+  }
+  void load_constant(int64_t value) {
+    if (number == JIT_REAL) return load_constant(static_cast<double>(value));
+    e.emit({ 0x48, 0xB8 }); e.emit64(static_cast<uint64_t>(value));
+  }
+  // al (0/1) -> xmm0 as 0.0/1.0, or rax as 0/1
+  void bool_result() {
+    e.emit({ 0x0F, 0xB6, 0xC0 });
+    if (number == JIT_REAL) e.emit({ 0xF2, 0x0F, 0x2A, 0xC0 });
+  }
+  // leaves the call to the interpreter, which promotes to double here
+  void promote_on(std::initializer_list<uint8_t> jcc) { to_promote.push_back(e.jump(jcc)); }
+
+  // jumps when the value is falsy; a double NaN counts as truthy like is_truthy
+  size_t jump_if_falsy() {
+    if (number == JIT_INTEGER) {
+      e.emit({ 0x48, 0x85, 0xC0 });
+      return e.jump({ 0x0F, 0x84 });
+    }
+    e.emit({ 0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1 });
+    size_t truthy = e.jump({ 0x0F, 0x8A });
+    size_t falsy = e.jump({ 0x0F, 0x84 });
+    e.bind(truthy);
+    return falsy;
+  }
+
+  // rax op rcx. the interpreter keeps integers only while results are exact
+  void gen_integer(TokenType op) {
+    switch (op) {
+    case PLUS: e.emit({ 0x48, 0x01, 0xC8 }); promote_on({ 0x0F, 0x80 }); break;
+    case MINUS: e.emit({ 0x48, 0x29, 0xC8 }); promote_on({ 0x0F, 0x80 }); break;
+    case STAR: e.emit({ 0x48, 0x0F, 0xAF, 0xC1 }); promote_on({ 0x0F, 0x80 }); break;
+    case SLASH: case PERCENTAGE: {
+      // test rcx, rcx; jz promote; cmp rcx, -1; je minus_one
+      e.emit({ 0x48, 0x85, 0xC9 });
+      promote_on({ 0x0F, 0x84 });
+      e.emit({ 0x48, 0x83, 0xF9, 0xFF });
+      size_t minus_one = e.jump({ 0x0F, 0x84 });
+      // cqo; idiv rcx
+      e.emit({ 0x48, 0x99, 0x48, 0xF7, 0xF9 });
+      if (op == SLASH) {
+        // test rdx, rdx; jnz promote
+        e.emit({ 0x48, 0x85, 0xD2 });
+        promote_on({ 0x0F, 0x85 });
+      } else {
+        // mov rax, rdx
+        e.emit({ 0x48, 0x89, 0xD0 });
+      }
+      size_t done = e.jump({ 0xE9 });
+      e.bind(minus_one);
+      if (op == SLASH) {
+        // neg rax; jo promote
+        e.emit({ 0x48, 0xF7, 0xD8 });
+        promote_on({ 0x0F, 0x80 });
+      } else {
+        // xor eax, eax
+        e.emit({ 0x31, 0xC0 });
+      }
+      e.bind(done);
+      break;
+    }
+    case AND: e.emit({ 0x48, 0x21, 0xC8 }); break;
+    case OR: e.emit({ 0x48, 0x09, 0xC8 }); break;
+    case XOR: e.emit({ 0x48, 0x31, 0xC8 }); break;
+    case LEFT_SHIFT: case RIGHT_SHIFT:
+      // counts outside 0..63 are rare enough to leave to the interpreter:
+      // cmp rcx, 63; ja promote; shl/sar rax, cl
+      e.emit({ 0x48, 0x83, 0xF9, 0x3F });
+      promote_on({ 0x0F, 0x87 });
+      e.emit({ 0x48, 0xD3, static_cast<uint8_t>(op == LEFT_SHIFT ? 0xE0 : 0xF8) });
+      break;
+    case GREATER: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x9F, 0xC0 }); bool_result(); break;
+    case GREATER_EQUAL: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x9D, 0xC0 }); bool_result(); break;
+    case LESS: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x9C, 0xC0 }); bool_result(); break;
+    case LESS_EQUAL: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x9E, 0xC0 }); bool_result(); break;
+    case EQUAL_EQUAL: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x94, 0xC0 }); bool_result(); break;
+    case BANG_EQUAL: e.emit({ 0x48, 0x39, 0xC8, 0x0F, 0x95, 0xC0 }); bool_result(); break;
+    default: break;
+    }
+  }
+
+  // xmm0 op xmm1
+  void gen_real(TokenType op) {
+    switch (op) {
+    case PLUS: e.emit({ 0xF2, 0x0F, 0x58, 0xC1 }); break;
+    case MINUS: e.emit({ 0xF2, 0x0F, 0x5C, 0xC1 }); break;
+    case STAR: e.emit({ 0xF2, 0x0F, 0x59, 0xC1 }); break;
+    case SLASH: e.emit({ 0xF2, 0x0F, 0x5E, 0xC1 }); break;
+    case GREATER: e.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x97, 0xC0 }); bool_result(); break;
+    case GREATER_EQUAL: e.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x93, 0xC0 }); bool_result(); break;
+    case LESS: e.emit({ 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0 }); bool_result(); break;
+    case LESS_EQUAL: e.emit({ 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x93, 0xC0 }); bool_result(); break;
+    case EQUAL_EQUAL: e.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 }); bool_result(); break;
+    case BANG_EQUAL: e.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8 }); bool_result(); break;
+    default: break;
+    }
+  }
+
+  void gen(const Expr* expr) {
+    expr = strip(expr);
+
+    if (auto* literal = dynamic_cast<const Literal*>(expr)) {
+      if (literal->value.type() == typeid(bool))
+        load_constant(int64_t(std::any_cast<bool>(literal->value) ? 1 : 0));
+      else if (literal->value.type() == typeid(int64_t))
+        load_constant(std::any_cast<int64_t>(literal->value));
+      else
+        load_constant(std::any_cast<double>(literal->value));
+    } else if (auto* variable = dynamic_cast<const Variable*>(expr)) {
+      // mov rax, [rbx + disp32] / movsd xmm0, [rbx + disp32]
+      if (number == JIT_INTEGER) e.emit({ 0x48, 0x8B, 0x83 });
+      else e.emit({ 0xF2, 0x0F, 0x10, 0x83 });
+      e.emit32(static_cast<int32_t>(8 * params[variable->label->lexeme]));
+    } else if (auto* unary = dynamic_cast<const Unary*>(expr)) {
+      gen(unary->right.get());
+      if (number == JIT_INTEGER) {
+        switch (unary->op->type) {
+        // neg rax; jo promote (only INT64_MIN overflows)
+        case MINUS: e.emit({ 0x48, 0xF7, 0xD8 }); promote_on({ 0x0F, 0x80 }); break;
+        // not rax
+        case NOT: e.emit({ 0x48, 0xF7, 0xD0 }); break;
+        // test rax, rax; sete al
+        default: e.emit({ 0x48, 0x85, 0xC0, 0x0F, 0x94, 0xC0 }); bool_result(); break;
+        }
+      } else if (unary->op->type == MINUS) {
+        e.emit({ 0x48, 0xB8 }); e.emit64(0x8000000000000000ull);
+        e.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC8, 0x66, 0x0F, 0x57, 0xC1 });
+      } else {
+        // !x == (x == 0.0 and ordered)
+        e.emit({ 0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 });
+        bool_result();
+      }
+    } else if (auto* binary = dynamic_cast<const Binary*>(expr)) {
+      gen(binary->left.get());
+      push();
+      gen(binary->right.get());
+      pop_left();
+      if (number == JIT_INTEGER) gen_integer(binary->op->type);
+      else gen_real(binary->op->type);
+    } else if (auto* ternary = dynamic_cast<const Ternary*>(expr)) {
+      gen(ternary->condition.get());
+      size_t falsy = jump_if_falsy();
+      gen(ternary->true_case.get());
+      size_t end = e.jump({ 0xE9 });
+      e.bind(falsy);
+      gen(ternary->false_case.get());
+      e.bind(end);
+    } else if (auto* call = dynamic_cast<const Call*>(expr)) {
+      int32_t area = static_cast<int32_t>((8 * call->args.size() + 15) & ~size_t(15));
+      if (area) { e.emit({ 0x48, 0x81, 0xEC }); e.emit32(area); }
+      for (size_t i = 0; i < call->args.size(); ++i) {
+        gen(call->args[i].get());
+        // mov [rsp + disp32], rax / movsd [rsp + disp32], xmm0
+        if (number == JIT_INTEGER) e.emit({ 0x48, 0x89, 0x84, 0x24 });
+        else e.emit({ 0xF2, 0x0F, 0x11, 0x84, 0x24 });
+        e.emit32(static_cast<int32_t>(8 * i));
+      }
+      e.emit({ 0x48, 0x89, 0xE7, 0x4C, 0x89, 0xE6 });
+      to_entry.push_back(e.jump({ 0xE8 }));
+      if (area) { e.emit({ 0x48, 0x81, 0xC4 }); e.emit32(area); }
+      // unwind straight out when the callee bailed
+      e.emit({ 0x41, 0x80, 0x7C, 0x24, OFF_BAILED, 0x00 });
+      to_epilogue.push_back(e.jump({ 0x0F, 0x85 }));
+    }
+  }
+
+  void gen(const Stmt* stmt) {
+    if (auto* ret = dynamic_cast<const Return*>(stmt)) {
+      gen(ret->value.get());
+      to_epilogue.push_back(e.jump({ 0xE9 }));
+    } else if (auto* branch = dynamic_cast<const If*>(stmt)) {
+      gen(branch->condition.get());
+      size_t falsy = jump_if_falsy();
+      gen(branch->if_case.get());
+      e.bind(falsy);
+      if (branch->else_case)
+        gen(branch->else_case.get());
+    } else if (auto* block = dynamic_cast<const Block*>(stmt)) {
+      for (const auto& inner : block->statements)
+        gen(inner.get());
+    }
+  }
+
+public:
+  Compiler(const Function& function, JitType number) : function(function), number(number) {}
+
+  bool compile(std::vector<uint8_t>& out) {
+    for (size_t i = 0; i < function.params.size(); ++i) {
+      if (!params.emplace(function.params[i]->lexeme, i).second) return false;
+    }
+    if (!check(Parser::body(function))) return false;
+
+    // push rbp; mov rbp, rsp; push rbx; push r12; mov rbx, rdi; mov r12, rsi
+    size_t entry = e.code.size();
+    e.emit({ 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4 });
+    // dec qword [r12 + depth_left]; jnz body
+    e.emit({ 0x49, 0xFF, 0x4C, 0x24, OFF_DEPTH });
+    size_t body = e.jump({ 0x0F, 0x85 });
+    // mov byte [r12 + bailed], JIT_DEPTH
+    e.emit({ 0x41, 0xC6, 0x44, 0x24, OFF_BAILED, JIT_DEPTH });
+    to_epilogue.push_back(e.jump({ 0xE9 }));
+    e.bind(body);
+    // dec qword [r12 + fuel]; jns fueled; and rsp, -16; mov rdi, r12;
+    // call [r12 + refuel]; lea rsp, [rbp - 16]; test al, al; jnz fueled.
+    // nothing is live in caller-saved registers on entry
+    e.emit({ 0x49, 0xFF, 0x4C, 0x24, OFF_FUEL });
+    size_t fueled = e.jump({ 0x0F, 0x89 });
+    e.emit({ 0x48, 0x83, 0xE4, 0xF0, 0x4C, 0x89, 0xE7, 0x41, 0xFF, 0x54, 0x24, OFF_REFUEL, 0x48, 0x8D, 0x65, 0xF0, 0x84, 0xC0 });
+    size_t refueled = e.jump({ 0x0F, 0x85 });
+    // mov byte [r12 + bailed], JIT_FUEL
+    e.emit({ 0x41, 0xC6, 0x44, 0x24, OFF_BAILED, JIT_FUEL });
+    to_epilogue.push_back(e.jump({ 0xE9 }));
+    e.bind(fueled);
+    e.bind(refueled);
+
+    for (const auto& stmt : Parser::body(function))
+      gen(stmt.get());
+
+    // mov byte [r12 + bailed], JIT_NUMBER
+    if (!to_promote.empty()) {
+      for (size_t patch : to_promote)
+        e.bind(patch);
+      e.emit({ 0x41, 0xC6, 0x44, 0x24, OFF_BAILED, JIT_NUMBER });
+    }
+
+    // inc qword [r12 + depth_left]; lea rsp, [rbp - 16]; pop r12; pop rbx;
+    // pop rbp; ret. a bailout arrives with operands still pushed, so rsp is
+    // reset from the frame pointer rather than trusted
+    for (size_t patch : to_epilogue)
+      e.bind(patch);
+    e.emit({ 0x49, 0xFF, 0x44, 0x24, OFF_DEPTH, 0x48, 0x8D, 0x65, 0xF0, 0x41, 0x5C, 0x5B, 0x5D, 0xC3 });
+
+    for (size_t patch : to_entry)
+      e.bind(patch, entry);
+
+    out = std::move(e.code);
+    return true;
+  }
+};
+
+// generated code is shared by every interpreter and lives for the process
+static void* install(const std::vector<uint8_t>& code) {
+  static std::mutex lock;
+  std::lock_guard<std::mutex> guard(lock);
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (code.size() + page - 1) / page * page;
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return nullptr;
+
+  std::memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return nullptr;
+  }
+  return memory;
+}
+
+bool Jit::available() { return true; }
+
+native_fn Jit::compile(const Function& function) {
+  std::vector<uint8_t> code;
+  if (!Compiler(function, JIT_REAL).compile(code))
+    return nullptr;
+  return reinterpret_cast<native_fn>(install(code));
+}
+
+integer_native_fn Jit::compile_integer(const Function& function) {
+  std::vector<uint8_t> code;
+  if (!Compiler(function, JIT_INTEGER).compile(code))
+    return nullptr;
+  return reinterpret_cast<integer_native_fn>(install(code));
+}
+
+#else
+
+bool Jit::available() { return false; }
+
+native_fn Jit::compile(const Function& function) { return nullptr; }
+
+integer_native_fn Jit::compile_integer(const Function& function) { return nullptr; }
+
+#endif
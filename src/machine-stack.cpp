@@ -0,0 +1,97 @@
+#include <machine-stack>
+#include <exception>
+#include <stdexcept>
+
+#ifdef __linux__
+#define OWO_MACHINE_STACK 1
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+// room kept free below the deepest frame for natives, printing and unwinding
+static const size_t reserve = 256 * 1024;
+
+#ifdef OWO_MACHINE_STACK
+
+namespace {
+  struct Entry {
+    const std::function<void()>* task;
+    std::exception_ptr error;
+    ucontext_t caller;
+  };
+
+  // makecontext only passes ints, hand the entry over through here instead
+  thread_local Entry* starting = nullptr;
+
+  void trampoline() {
+    Entry* entry = starting;
+    try {
+      (*entry->task)();
+    } catch (...) {
+      entry->error = std::current_exception();
+    }
+    // returning resumes entry->caller through uc_link
+  }
+}
+
+MachineStack::MachineStack(size_t size) {
+  long page = sysconf(_SC_PAGESIZE);
+  this->size = (size + reserve + page - 1) / page * page;
+}
+
+MachineStack::~MachineStack() {
+  if (base)
+    munmap(base - sysconf(_SC_PAGESIZE), size + sysconf(_SC_PAGESIZE));
+}
+
+void MachineStack::run(const std::function<void()>& task) {
+  if (active) {
+    task();
+    return;
+  }
+
+  if (!base) {
+    // one inaccessible guard page below the stack
+    size_t page = sysconf(_SC_PAGESIZE);
+    void* mapping = mmap(nullptr, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+      throw std::runtime_error("Could not map interpreter stack.");
+    mprotect(mapping, page, PROT_NONE);
+    base = static_cast<char*>(mapping) + page;
+  }
+
+  Entry entry{ &task, nullptr, {} };
+  ucontext_t context;
+  getcontext(&context);
+  context.uc_stack.ss_sp = base;
+  context.uc_stack.ss_size = size;
+  context.uc_link = &entry.caller;
+  makecontext(&context, trampoline, 0);
+
+  starting = &entry;
+  active = true;
+  swapcontext(&entry.caller, &context);
+  active = false;
+
+  if (entry.error)
+    std::rethrow_exception(entry.error);
+}
+
+bool MachineStack::exhausted() const {
+  char marker;
+  return active && &marker >= base && static_cast<size_t>(&marker - base) < reserve;
+}
+
+#else
+
+// no context switching here: run on the thread's own stack and rely on the
+// depth limit alone
+MachineStack::MachineStack(size_t size) : size(size) {}
+MachineStack::~MachineStack() {}
+
+void MachineStack::run(const std::function<void()>& task) { task(); }
+
+bool MachineStack::exhausted() const { return false; }
+
+#endif
\ No newline at end of file
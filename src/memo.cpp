@@ -0,0 +1,172 @@
+#include <memo>
+#include <parser>
+#include <cstring>
+#include <set>
+
+MemoTable::MemoTable() : entries(capacity) {}
+
+// murmur3's finalizer over the running hash, so that doubles, which differ
+// mostly in their high bits, still spread over the slots
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ull;
+  return hash ^ (hash >> 33);
+}
+
+// doubles are keyed by their bits: 0.0 and -0.0 give different results
+// (1 / x) so they can't share an entry, and a NaN argument still hits
+static uint64_t bits(double number) {
+  uint64_t bits;
+  std::memcpy(&bits, &number, sizeof bits);
+  return bits;
+}
+
+bool MemoTable::key(Arguments arguments, uint64_t& hash) {
+  hash = 0;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::any& arg = arguments[i];
+    if (const int64_t* integer = std::any_cast<int64_t>(&arg)) {
+      hash = mix(hash, static_cast<uint64_t>(*integer));
+    } else if (const double* number = std::any_cast<double>(&arg)) {
+      hash = mix(hash, bits(*number));
+    } else if (const bool* boolean = std::any_cast<bool>(&arg)) {
+      hash = mix(hash, *boolean ? 1 : 2);
+    } else if (const std::string* string = std::any_cast<std::string>(&arg)) {
+      hash = mix(hash, std::hash<std::string>()(*string));
+    } else if (arg.type() == typeid(nullptr_t)) {
+      hash = mix(hash, 3);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool same(const std::any& left, const std::any& right) {
+  if (left.type() != right.type())
+    return false;
+  if (const int64_t* integer = std::any_cast<int64_t>(&left))
+    return *integer == std::any_cast<int64_t>(right);
+  if (const double* number = std::any_cast<double>(&left))
+    return bits(*number) == bits(std::any_cast<double>(right));
+  if (const bool* boolean = std::any_cast<bool>(&left))
+    return *boolean == std::any_cast<bool>(right);
+  if (const std::string* string = std::any_cast<std::string>(&left))
+    return *string == std::any_cast<const std::string&>(right);
+  return true;
+}
+
+const std::any* MemoTable::find(uint64_t hash, Arguments arguments) {
+  const Entry& entry = entries[hash % capacity];
+  if (entry.used && entry.hash == hash) {
+    bool match = true;
+    for (size_t i = 0; match && i < arguments.size(); ++i)
+      match = same(entry.args[i], arguments[i]);
+    if (match) {
+      ++hits;
+      return &entry.value;
+    }
+  }
+  ++misses;
+  return nullptr;
+}
+
+void MemoTable::store(uint64_t hash, Arguments arguments, const std::any& value) {
+  Entry& entry = entries[hash % capacity];
+  entry.hash = hash;
+  entry.used = true;
+  entry.args.clear();
+  for (size_t i = 0; i < arguments.size(); ++i)
+    entry.args.push_back(arguments[i]);
+  entry.value = value;
+}
+
+// walks a body with the names in scope, rejecting anything it does not know
+class Purity {
+  const std::string& self;
+  std::vector<std::set<std::string>> scopes;
+
+  bool local(const std::string& name) {
+    for (const auto& scope : scopes)
+      if (scope.count(name)) return true;
+    return false;
+  }
+
+  bool declare(const std::string& name) {
+    if (name == self) return false;
+    scopes.back().insert(name);
+    return true;
+  }
+
+public:
+  Purity(const Function& function) : self(function.name->lexeme), scopes(1) {}
+
+  bool check(const Expr* expr) {
+    if (!expr) return true;
+    if (dynamic_cast<const Literal*>(expr)) return true;
+    if (auto* grouping = dynamic_cast<const Grouping*>(expr))
+      return check(grouping->expression.get());
+    if (auto* unary = dynamic_cast<const Unary*>(expr))
+      return check(unary->right.get());
+    if (auto* binary = dynamic_cast<const Binary*>(expr))
+      return check(binary->left.get()) && check(binary->right.get());
+    if (auto* ternary = dynamic_cast<const Ternary*>(expr))
+      return check(ternary->condition.get()) && check(ternary->true_case.get()) && check(ternary->false_case.get());
+    if (auto* variable = dynamic_cast<const Variable*>(expr))
+      return variable->label->lexeme == self || local(variable->label->lexeme);
+    if (auto* assign = dynamic_cast<const Assign*>(expr))
+      return local(assign->name->lexeme) && check(assign->value.get());
+    if (auto* call = dynamic_cast<const Call*>(expr)) {
+      auto* callee = dynamic_cast<const Variable*>(call->callee.get());
+      if (!callee || callee->label->lexeme != self) return false;
+      for (const auto& arg : call->args)
+        if (!check(arg.get())) return false;
+      return true;
+    }
+    return false;
+  }
+
+  bool check(const Stmt* stmt) {
+    if (!stmt) return true;
+    if (auto* expression = dynamic_cast<const Expression*>(stmt)) {
+      for (const auto& expr : expression->expressions)
+        if (!check(expr.get())) return false;
+      return true;
+    }
+    if (auto* var = dynamic_cast<const Var*>(stmt)) {
+      for (const auto& variable : var->variables)
+        if (!check(variable.second.get()) || !declare(variable.first->lexeme)) return false;
+      return true;
+    }
+    if (auto* ret = dynamic_cast<const Return*>(stmt))
+      return check(ret->value.get());
+    if (auto* branch = dynamic_cast<const If*>(stmt))
+      return check(branch->condition.get()) && check(branch->if_case.get()) && check(branch->else_case.get());
+    if (auto* block = dynamic_cast<const Block*>(stmt)) {
+      scopes.emplace_back();
+      bool pure = check(block->statements);
+      scopes.pop_back();
+      return pure;
+    }
+    return false;
+  }
+
+  bool check(const std::vector<std::unique_ptr<Stmt>>& stmts) {
+    for (const auto& stmt : stmts)
+      if (!check(stmt.get())) return false;
+    return true;
+  }
+
+  bool check(const Function& function) {
+    for (const Token* param : function.params)
+      if (!declare(param->lexeme)) return false;
+    return check(Parser::body(function));
+  }
+};
+
+bool MemoTable::is_pure(const Function& function) {
+  return Purity(function).check(function);
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <number>
+#include <exceptions>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+bool exact_integer(double value, int64_t& integer) {
+  // 2^63 is the first double past the int64 range
+  if (!(value >= -9223372036854775808.0 && value < 9223372036854775808.0) || value != std::trunc(value))
+    return false;
+  integer = static_cast<int64_t>(value);
+  return true;
+}
+
+bool exact_integer(const std::any& value, int64_t& integer) {
+  if (const int64_t* number = std::any_cast<int64_t>(&value)) {
+    integer = *number;
+    return true;
+  }
+  return exact_integer(std::any_cast<double>(value), integer);
+}
+
+// operand of a bitwise operator: doubles are truncated toward zero
+static int64_t bits(const std::any& value, const Token* token) {
+  if (const int64_t* integer = std::any_cast<int64_t>(&value))
+    return *integer;
+  double number = std::trunc(std::any_cast<double>(value));
+  int64_t integer;
+  if (!exact_integer(number, integer))
+    throw RuntimeError("Bitwise operands must fit in 64 bits.", token);
+  return integer;
+}
+
+static std::any integer_binary(TokenType op, int64_t left, int64_t right) {
+  int64_t result;
+  switch (op) {
+  case TokenType::PLUS:
+    if (__builtin_add_overflow(left, right, &result)) return static_cast<double>(left) + static_cast<double>(right);
+    return result;
+  case TokenType::MINUS:
+    if (__builtin_sub_overflow(left, right, &result)) return static_cast<double>(left) - static_cast<double>(right);
+    return result;
+  case TokenType::STAR:
+    if (__builtin_mul_overflow(left, right, &result)) return static_cast<double>(left) * static_cast<double>(right);
+    return result;
+  case TokenType::SLASH:
+    if (right == 0 || (left == INT64_MIN && right == -1) || left % right != 0)
+      return static_cast<double>(left) / static_cast<double>(right);
+    return left / right;
+  case TokenType::PERCENTAGE:
+    if (right == 0) return std::fmod(static_cast<double>(left), 0.0);
+    return right == -1 ? int64_t(0) : left % right;
+  case TokenType::GREATER: return left > right;
+  case TokenType::GREATER_EQUAL: return left >= right;
+  case TokenType::LESS: return left < right;
+  case TokenType::LESS_EQUAL: return left <= right;
+  case TokenType::EQUAL_EQUAL: return left == right;
+  case TokenType::BANG_EQUAL: return left != right;
+  case TokenType::AND_AND: return left != 0 && right != 0;
+  case TokenType::OR_OR: return left != 0 || right != 0;
+  }
+  return nullptr;
+}
+
+// an integer ordered against a double exactly, like number_equal, where
+// converting the integer could round it onto the double. integer_left
+// says which side the integer was on
+static bool mixed_compare(TokenType op, int64_t integer, double real, bool integer_left) {
+  if (std::isnan(real))
+    return false;
+  // -1, 0 or 1 as integer is below, at or above real
+  int order;
+  if (real >= 9223372036854775808.0) {
+    order = -1;
+  } else if (real < -9223372036854775808.0) {
+    order = 1;
+  } else {
+    double whole = std::trunc(real);
+    int64_t truncated = static_cast<int64_t>(whole);
+    if (integer != truncated) order = integer < truncated ? -1 : 1;
+    else order = real > whole ? -1 : real < whole ? 1 : 0;
+  }
+  if (!integer_left)
+    order = -order;
+  switch (op) {
+  case TokenType::GREATER: return order > 0;
+  case TokenType::GREATER_EQUAL: return order >= 0;
+  case TokenType::LESS: return order < 0;
+  default: return order <= 0;
+  }
+}
+
+std::any number_binary(TokenType op, const std::any& left, const std::any& right, const Token* token) {
+  switch (op) {
+  case TokenType::AND: return bits(left, token) & bits(right, token);
+  case TokenType::OR: return bits(left, token) | bits(right, token);
+  case TokenType::XOR: return bits(left, token) ^ bits(right, token);
+  // shifts wrap like the machine's; counts past the width shift everything out
+  case TokenType::LEFT_SHIFT: {
+    int64_t value = bits(left, token), count = bits(right, token);
+    return count < 0 || count > 63 ? int64_t(0) : static_cast<int64_t>(static_cast<uint64_t>(value) << count);
+  }
+  case TokenType::RIGHT_SHIFT: {
+    int64_t value = bits(left, token), count = bits(right, token);
+    return count < 0 || count > 63 ? int64_t(value < 0 ? -1 : 0) : value >> count;
+  }
+  case TokenType::EQUAL_EQUAL: return number_equal(left, right);
+  case TokenType::BANG_EQUAL: return !number_equal(left, right);
+  }
+
+  const int64_t* l = std::any_cast<int64_t>(&left);
+  const int64_t* r = std::any_cast<int64_t>(&right);
+  if (l && r)
+    return integer_binary(op, *l, *r);
+  if ((l || r) && (op == TokenType::GREATER || op == TokenType::GREATER_EQUAL || op == TokenType::LESS || op == TokenType::LESS_EQUAL))
+    return mixed_compare(op, l ? *l : *r, std::any_cast<double>(l ? right : left), l != nullptr);
+
+  double x = number_value(left), y = number_value(right);
+  switch (op) {
+  case TokenType::PLUS: return x + y;
+  case TokenType::MINUS: return x - y;
+  case TokenType::STAR: return x * y;
+  case TokenType::SLASH: return x / y;
+  case TokenType::PERCENTAGE: return std::fmod(x, y);
+  case TokenType::GREATER: return x > y;
+  case TokenType::GREATER_EQUAL: return x >= y;
+  case TokenType::LESS: return x < y;
+  case TokenType::LESS_EQUAL: return x <= y;
+  case TokenType::AND_AND: return x != 0 && y != 0;
+  case TokenType::OR_OR: return x != 0 || y != 0;
+  }
+  return nullptr;
+}
+
+std::any number_negate(const std::any& value) {
+  if (const int64_t* integer = std::any_cast<int64_t>(&value)) {
+    if (*integer == INT64_MIN) return -static_cast<double>(*integer);
+    return -*integer;
+  }
+  return -std::any_cast<double>(value);
+}
+
+std::any number_not(const std::any& value, const Token* token) {
+  return ~bits(value, token);
+}
+
+// exact across representations, so 2^53 + 1 is not equal to 2^53 as a double
+bool number_equal(const std::any& left, const std::any& right) {
+  const int64_t* l = std::any_cast<int64_t>(&left);
+  const int64_t* r = std::any_cast<int64_t>(&right);
+  if (l && r) return *l == *r;
+  if (!l && !r) return std::any_cast<double>(left) == std::any_cast<double>(right);
+
+  int64_t integer;
+  return exact_integer(l ? right : left, integer) && integer == (l ? *l : *r);
+}
+
+std::string number_to_string(const std::any& value) {
+  if (const int64_t* integer = std::any_cast<int64_t>(&value))
+    return std::to_string(*integer);
+
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(15) << std::any_cast<double>(value);
+  std::string str_value = oss.str();
+
+  str_value.erase(str_value.find_last_not_of('0') + 1);
+  if (str_value.back() == '.')
+    str_value.pop_back();
+  return str_value;
+}
@@ -1,23 +1,41 @@
 #include <owo>
 #include <iostream>
 #include <fstream>
-#include <scanner>
-#include <parser>
+#include <sstream>
+#include <script>
+#include <thread-pool>
 #include <ast-printer>
+#include <repl>
+
+owo::owo(std::ostream& out, const Options& opts) : out(out), opts(opts) {}
 
 void owo::run(const std::string& source, Interpreter& interpreter, const int mode) {
-  Scanner scanner = Scanner(source);
-  const std::vector<std::unique_ptr<Token>>& tokens = scanner.scan_tokens();
-  Parser parser = Parser(tokens);
-  const std::vector<std::unique_ptr<Stmt>>& stmts = parser.parse();
+  Script script(source, *this);
 
-  if (owo::had_error) return;
+  if (had_error) return;
 
   interpreter.set_mode(mode);
-  interpreter.interpret(stmts);
+  interpreter.interpret(script.statements());
+
+  // a snapshot that can't be saved fails the run like a runtime error
+  if (mode == 0 && !opts.save_snapshot.empty() && !had_runtime_error) {
+    try {
+      Snapshot::save(opts.save_snapshot, *this, interpreter, script);
+    } catch (const std::runtime_error& error) {
+      runtime_error(RuntimeError(error.what(), nullptr));
+    }
+  }
 }
 
-void owo::run_file(const std::string& path) {
+void owo::restore(Interpreter& interpreter) {
+  if (opts.snapshot.empty())
+    return;
+  if (!snapshot)
+    snapshot = std::make_unique<Snapshot>(opts.snapshot, *this);
+  snapshot->restore(interpreter);
+}
+
+std::string owo::read_file(const std::string& path) {
   std::ifstream file(path, std::ios::binary);
 
   if (!file)
@@ -32,52 +50,105 @@ void owo::run_file(const std::string& path) {
   if (!file.read(&content[0], size))
     throw std::runtime_error("Error reading file: " + std::string(path));
 
-  Interpreter interpreter;
-  owo::run(content, interpreter, 0);
+  return content;
+}
+
+void owo::run_file(const std::string& path) {
+  std::string content = read_file(path);
 
-  if (owo::had_error)
+  Interpreter interpreter(*this);
+  restore(interpreter);
+  run(content, interpreter, 0);
+
+  if (had_error)
     exit(64);
-  if (owo::had_runtime_error)
+  if (had_budget_error)
+    exit(75);
+  if (had_runtime_error)
     exit(70);
 }
 
-void owo::run_prompt() {
-  Interpreter interpreter;
-  std::string input_buffer;
-  while (true) {
-    std::cout << ">>> ";
-    std::getline(std::cin, input_buffer);
+void owo::run_batch(const std::vector<std::string>& paths) {
+  struct Unit {
+    std::ostringstream diagnostics;
+    std::unique_ptr<owo> reporter;
+    std::unique_ptr<Script> script;
+  };
+  std::vector<Unit> units(paths.size());
+
+  // scan and parse every file in parallel, each with its own reporter
+  {
+    ThreadPool pool;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      pool.submit([this, &paths, &units, i] {
+        Unit& unit = units[i];
+        unit.reporter = std::make_unique<owo>(unit.diagnostics, opts);
+        try {
+          unit.script = std::make_unique<Script>(read_file(paths[i]), *unit.reporter);
+        } catch (const std::runtime_error& error) {
+          unit.diagnostics << error.what() << std::endl;
+        }
+      });
+    }
+    pool.wait();
+  }
 
-    if (input_buffer == "exit")
-      break;
+  // diagnostics go out in argument order regardless of which file finished first
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (units[i].script && units[i].script->valid()) continue;
+    out << paths[i] << ":" << std::endl << units[i].diagnostics.str();
+    had_error = true;
+  }
+  if (had_error)
+    exit(64);
 
-    try {
-      owo::run(input_buffer, interpreter, 1);
-    } catch (const std::runtime_error& ) {}
-    owo::had_error = false;
+  for (auto& unit : units) {
+    Interpreter interpreter(*this);
+    restore(interpreter);
+    interpreter.interpret(unit.script->statements());
   }
+
+  if (had_budget_error)
+    exit(75);
+  if (had_runtime_error)
+    exit(70);
+}
+
+void owo::run_prompt() {
+  Repl repl(*this);
+  restore(repl.interpreter());
+  repl.run(std::cin);
 }
 
 void owo::error(int line, std::string message) {
-  owo::report(line, "", message);
+  report(line, "", message);
+}
+
+void owo::error_at_end(int line, std::string message) {
+  if (!had_error) had_error_at_end = true;
+  report(line, "", message);
 }
 
 void owo::report(int line, std::string where, std::string message) {
-  std::cout << "[line " << line << "] Error " << where << ": " << message << std::endl;
-  owo::had_error = true;
+  out << "[line " << line << "] Error " << where << ": " << message << std::endl;
+  had_error = true;
 }
 
 void owo::error(const Token* token, std::string message) {
-  if (token->type == OWO_EOF)
-    owo::report(token->line, "at end", message);
-  else
-    owo::report(token->line, "at '" + token->lexeme + "'", message);
+  if (token->type == OWO_EOF) {
+    if (!had_error) had_error_at_end = true;
+    report(token->line, "at end", message);
+  } else {
+    report(token->line, "at '" + token->lexeme + "'", message);
+  }
 }
 
 void owo::runtime_error(const RuntimeError& error) {
-  std::cout << error.what() << "\n[line " << error.token->line << "]" << std::endl;
-  owo::had_runtime_error = true;
+  out << error.what();
+  if (error.token)
+    out << "\n[line " << error.token->line << "]";
+  out << std::endl;
+  had_runtime_error = true;
+  if (dynamic_cast<const BudgetError*>(&error))
+    had_budget_error = true;
 }
-
-bool owo::had_error = false;
-bool owo::had_runtime_error = false;
\ No newline at end of file
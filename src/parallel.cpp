@@ -0,0 +1,124 @@
+#include <parallel>
+#include <interpreter>
+#include <callable-function>
+#include <owo>
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <sstream>
+
+struct Parallel::Worker {
+  // pure functions print nothing, but the interpreter wants a session
+  std::ostringstream out;
+  owo session;
+  Interpreter interpreter;
+
+  Worker(const Options& options) : session(out, options), interpreter(session) {}
+};
+
+Parallel::Parallel(const Options& options) : options(options) {}
+
+Parallel::~Parallel() = default;
+
+std::unique_ptr<Parallel::Worker> Parallel::borrow() {
+  std::unique_ptr<Worker> worker;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!idle.empty()) {
+      worker = std::move(idle.back());
+      idle.pop_back();
+    }
+  }
+  if (!worker)
+    worker = std::make_unique<Worker>(options);
+  return worker;
+}
+
+void Parallel::give_back(std::unique_ptr<Worker> worker) {
+  std::lock_guard<std::mutex> guard(lock);
+  idle.push_back(std::move(worker));
+}
+
+bool Parallel::parallel(const std::any& function, size_t size) const {
+  const CallableFunction* callable = std::any_cast<CallableFunction>(&function);
+  return callable && size > 1 && pool.size() > 1 && MemoTable::is_pure(callable->declaration);
+}
+
+// a few chunks per thread so stealing can even out uneven elements
+size_t Parallel::chunk_count(size_t size) const {
+  return std::min(size, pool.size() * 4);
+}
+
+template <typename F>
+void Parallel::chunks(Interpreter& caller, size_t size, F task) {
+  size_t count = chunk_count(size);
+  std::vector<std::exception_ptr> errors(count);
+
+  // the workers spend the caller's steps up to its deadline, and split the
+  // heap it has left between the threads
+  Budget::Share share;
+  caller.budget.lend(share);
+  size_t room = caller.heap.headroom();
+  size_t heap_share = room == SIZE_MAX ? 0 : std::max<size_t>(1, room / pool.size());
+
+  for (size_t chunk = 0; chunk < count; ++chunk) {
+    pool.submit([this, &task, &errors, &share, heap_share, chunk, count, size] {
+      std::unique_ptr<Worker> worker = borrow();
+      Interpreter& interpreter = worker->interpreter;
+      interpreter.budget.start(share);
+      interpreter.heap.set_limit(heap_share ? interpreter.heap.bytes() + heap_share : 0);
+      try {
+        task(interpreter, chunk, chunk * size / count, (chunk + 1) * size / count);
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+      interpreter.budget.settle();
+      give_back(std::move(worker));
+    });
+  }
+  pool.wait();
+  caller.budget.reclaim(share);
+
+  for (const std::exception_ptr& error : errors)
+    if (error) std::rethrow_exception(error);
+}
+
+array_t Parallel::map(Interpreter& caller, std::any function, const Array& items) {
+  std::vector<std::any> results(items.size());
+  if (parallel(function, items.size())) {
+    chunks(caller, items.size(), [&](Interpreter& interpreter, size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i)
+        results[i] = interpreter.call(function, { items.get(i) });
+    });
+  } else {
+    for (size_t i = 0; i < items.size(); ++i)
+      results[i] = caller.call(function, { items.get(i) });
+  }
+
+  array_t array = caller.heap.make<Array>();
+  for (const std::any& result : results)
+    array->push(result);
+  return array;
+}
+
+std::any Parallel::reduce(Interpreter& caller, std::any function, const Array& items, std::any initial) {
+  std::any result = std::move(initial);
+  if (!parallel(function, items.size())) {
+    for (size_t i = 0; i < items.size(); ++i)
+      result = caller.call(function, { result, items.get(i) });
+    return result;
+  }
+
+  // each chunk folds from its own first element, the caller folds the
+  // chunks into initial in order
+  std::vector<std::any> partials(chunk_count(items.size()));
+  chunks(caller, items.size(), [&](Interpreter& interpreter, size_t chunk, size_t first, size_t last) {
+    std::any partial = items.get(first);
+    for (size_t i = first + 1; i < last; ++i)
+      partial = interpreter.call(function, { partial, items.get(i) });
+    partials[chunk] = partial;
+  });
+  for (const std::any& partial : partials)
+    result = caller.call(function, { result, partial });
+  return result;
+}
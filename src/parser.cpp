@@ -1,16 +1,48 @@
 #include <parser>
 #include <owo>
+#include <scanner>
+#include <array>
+#include <sstream>
+
+Parser::Parser(const std::vector<std::unique_ptr<Token>>& tokens, owo& reporter, bool lazy)
+  : tokens(tokens), reporter(reporter), lazy(lazy) {}
+
+// prefix/infix handlers and infix binding power per token type; tokens
+// without an entry can neither start nor continue an expression
+const ParseRule* Parser::rule(TokenType type) {
+  static const std::array<ParseRule, OWO_EOF + 1> rules = [] {
+    std::array<ParseRule, OWO_EOF + 1> rules{};
+    auto set = [&rules](std::initializer_list<TokenType> types, prefix_fn prefix, infix_fn infix, Precedence precedence) {
+      for (TokenType type : types)
+        rules[type] = { prefix, infix, precedence };
+    };
+
+    set({ FALSE, TRUE, NIL, NUMBER, STRING }, &Parser::literal, nullptr, PREC_NONE);
+    set({ IDENTIFIER }, &Parser::variable, nullptr, PREC_NONE);
+    set({ LEFT_PAREN }, &Parser::grouping, &Parser::call, PREC_CALL);
+    set({ LEFT_BRACKET }, &Parser::array, &Parser::index, PREC_CALL);
+    // a statement starting with '{' is still a block, see statement()
+    set({ LEFT_BRACE }, &Parser::map, nullptr, PREC_NONE);
+    set({ BANG, NOT }, &Parser::unary, nullptr, PREC_NONE);
+    set({ MINUS }, &Parser::unary, &Parser::binary, PREC_TERM);
+    set({ EQUAL }, nullptr, &Parser::assignment, PREC_ASSIGNMENT);
+    set({ QUESTION }, nullptr, &Parser::ternary, PREC_TERNARY);
+    set({ BANG_EQUAL, EQUAL_EQUAL }, nullptr, &Parser::binary, PREC_EQUALITY);
+    set({ AND, OR, XOR, LEFT_SHIFT, RIGHT_SHIFT }, nullptr, &Parser::binary, PREC_BITWISE);
+    set({ AND_AND, OR_OR }, nullptr, &Parser::binary, PREC_LOGICAL);
+    set({ GREATER, GREATER_EQUAL, LESS, LESS_EQUAL }, nullptr, &Parser::binary, PREC_COMPARISON);
+    set({ PLUS }, nullptr, &Parser::binary, PREC_TERM);
+    set({ STAR, SLASH, PERCENTAGE }, nullptr, &Parser::binary, PREC_FACTOR);
+    return rules;
+  }();
+
+  return &rules[type];
+}
 
-Parser::Parser(const std::vector<std::unique_ptr<Token>>& tokens) : tokens(tokens) {}
-
-bool Parser::match(std::vector<TokenType> types) {
-  for (TokenType type : types) {
-    if (check(type)) {
-      advance();
-      return true;
-    }
-  }
-  return false;
+bool Parser::match(TokenType type) {
+  if (!check(type)) return false;
+  advance();
+  return true;
 }
 
 bool Parser::check(TokenType type) { return at_end() ? false : peek()->type == type; }
@@ -18,19 +50,19 @@ bool Parser::at_end() { return peek()->type == OWO_EOF; }
 
 const Token* Parser::advance() {
   if (!at_end()) current++;
-  return peek();
+  return previous();
 }
 
 const Token* Parser::peek() { return tokens[current].get(); }
 const Token* Parser::previous() { return tokens[current-1].get(); }
 
-const Token* Parser::consume(TokenType type, const std::string& message) {
+const Token* Parser::consume(TokenType type, const char* message) {
   if (check(type)) return advance();
   throw error(peek(), message);
 }
 
 ParseError Parser::error(const Token* token, const std::string& message) {
-  owo::error(token, message);
+  reporter.error(token, message);
   return ParseError(message);
 }
 
@@ -48,183 +80,155 @@ void Parser::synchronize() {
       case WHILE:
       case PRINT:
       case RETURN:
+      case YIELD:
         return;
     }
     advance();
   }
 }
 
-std::unique_ptr<Expr> Parser::finish_call(std::unique_ptr<Expr> callee) {
-  std::vector<std::unique_ptr<Expr>> arguments;
-
-  if (!check(RIGHT_PAREN)) {
-    do {
-      if (arguments.size() >= 255)
-        error(peek(), "Can't have more than 255 arguments.");
-      arguments.push_back(expression());
-    } while (match({ COMMA }));
-  }
-
-  const Token *paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
-
-  return std::make_unique<Call>(std::move(callee), paren, std::move(arguments));
-}
-
 std::vector<std::unique_ptr<Expr>> Parser::comma() {
   std::vector<std::unique_ptr<Expr>> expressions;
 
   do {
     std::unique_ptr<Expr> expr = expression();
     expressions.push_back(std::move(expr));
-  } while (match({ COMMA }));
+  } while (match(COMMA));
 
   return std::move(expressions);
 }
 
 std::unique_ptr<Expr> Parser::expression() {
-  return assignment();
+  return parse_precedence(PREC_ASSIGNMENT);
 }
 
-std::unique_ptr<Expr> Parser::assignment() {
-  std::unique_ptr<Expr> expr = ternary();
-
-  if (match({ EQUAL })) {
-    const Token* equals = previous();
-    std::unique_ptr<Expr> value = assignment();
+// parses an expression whose operators all bind at least as tight as precedence
+std::unique_ptr<Expr> Parser::parse_precedence(Precedence precedence) {
+  prefix_fn prefix = rule(peek()->type)->prefix;
+  if (!prefix)
+    throw error(peek(), "Expect expression.");
 
-    if (auto* variable = dynamic_cast<Variable*>(expr.get()))
-      return std::make_unique<Assign>(variable->label, std::move(value));
+  advance();
+  std::unique_ptr<Expr> expr = (this->*prefix)();
 
-    error(equals, "Invalid assignment target.");
+  while (true) {
+    const ParseRule* next = rule(peek()->type);
+    if (!next->infix || next->precedence < precedence) break;
+    advance();
+    expr = (this->*next->infix)(std::move(expr));
   }
 
   return expr;
 }
 
-std::unique_ptr<Expr> Parser::ternary() {
-  std::unique_ptr<Expr> expr = equality();
-
-  if (match({ QUESTION })) {
-    std::unique_ptr<Expr> true_case = expression();
-    consume(COLON, "Expected ':' afer true branch.");
-    std::unique_ptr<Expr> false_case = ternary();
-    return std::make_unique<Ternary>(std::move(expr), std::move(true_case), std::move(false_case));
+std::unique_ptr<Expr> Parser::literal() {
+  const Token* token = previous();
+  switch (token->type) {
+  case FALSE: return std::make_unique<Literal>(false);
+  case TRUE: return std::make_unique<Literal>(true);
+  case NUMBER: return std::make_unique<Literal>(token->object);
+  case STRING: return std::make_unique<Literal>(std::any_cast<std::string>(token->object));
+  default: return std::make_unique<Literal>(nullptr);
   }
-
-  return expr;
 }
 
-std::unique_ptr<Expr> Parser::equality() {
-  std::unique_ptr<Expr> expr = bitwise();
-
-  while (match({ BANG_EQUAL, EQUAL_EQUAL })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = bitwise();
-    expr = std::make_unique<Binary>(std::move(expr), std::move(op), std::move(right));
-  }
-
-  return expr;
+std::unique_ptr<Expr> Parser::variable() {
+  return std::make_unique<Variable>(previous());
 }
 
-std::unique_ptr<Expr> Parser::bitwise() {
-  std::unique_ptr<Expr> expr = logical();
-
-  while (match({ AND, OR, XOR, LEFT_SHIFT, RIGHT_SHIFT })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = logical();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
-
-  return expr;
+std::unique_ptr<Expr> Parser::grouping() {
+  std::unique_ptr<Expr> expr = expression();
+  consume(RIGHT_PAREN, "Expect ')' after expression.");
+  return std::make_unique<Grouping>(std::move(expr));
 }
 
-std::unique_ptr<Expr> Parser::logical() {
-  std::unique_ptr<Expr> expr = comparison();
-
-  while (match({ AND_AND, OR_OR })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = comparison();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
-
-  return expr;
+std::unique_ptr<Expr> Parser::unary() {
+  const Token* op = previous();
+  std::unique_ptr<Expr> right = parse_precedence(PREC_UNARY);
+  return std::make_unique<Unary>(op, std::move(right));
 }
 
-std::unique_ptr<Expr> Parser::comparison() {
-  std::unique_ptr<Expr> expr = term();
+// left associative: the right operand only takes tighter operators
+std::unique_ptr<Expr> Parser::binary(std::unique_ptr<Expr> left) {
+  const Token* op = previous();
+  std::unique_ptr<Expr> right = parse_precedence(static_cast<Precedence>(rule(op->type)->precedence + 1));
+  return std::make_unique<Binary>(std::move(left), op, std::move(right));
+}
 
-  while (match({ GREATER, GREATER_EQUAL, LESS, LESS_EQUAL })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = term();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
+std::unique_ptr<Expr> Parser::assignment(std::unique_ptr<Expr> left) {
+  const Token* equals = previous();
+  std::unique_ptr<Expr> value = parse_precedence(PREC_ASSIGNMENT);
 
-  return expr;
-}
+  if (auto* variable = dynamic_cast<Variable*>(left.get()))
+    return std::make_unique<Assign>(variable->label, std::move(value));
 
-std::unique_ptr<Expr> Parser::term() {
-  std::unique_ptr<Expr> expr = factor();
+  if (dynamic_cast<Index*>(left.get()))
+    return std::make_unique<IndexAssign>(std::move(left), std::move(value));
 
-  while (match({ MINUS, PLUS })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = factor();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
+  error(equals, "Invalid assignment target.");
+  return left;
+}
 
-  return expr;
+std::unique_ptr<Expr> Parser::ternary(std::unique_ptr<Expr> condition) {
+  std::unique_ptr<Expr> true_case = expression();
+  consume(COLON, "Expected ':' afer true branch.");
+  // right associative, and no assignment: "c ? a : b = 1" assigns to the
+  // whole ternary, which is an invalid target
+  std::unique_ptr<Expr> false_case = parse_precedence(PREC_TERNARY);
+  return std::make_unique<Ternary>(std::move(condition), std::move(true_case), std::move(false_case));
 }
 
-std::unique_ptr<Expr> Parser::factor() {
-  std::unique_ptr<Expr> expr = unary();
+std::unique_ptr<Expr> Parser::call(std::unique_ptr<Expr> callee) {
+  std::vector<std::unique_ptr<Expr>> arguments;
 
-  while (match({ STAR, SLASH, PERCENTAGE })) {
-    const Token *op = previous();
-    std::unique_ptr<Expr> right = unary();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+  if (!check(RIGHT_PAREN)) {
+    do {
+      if (arguments.size() >= max_args)
+        error(peek(), "Can't have more than 255 arguments.");
+      arguments.push_back(expression());
+    } while (match(COMMA));
   }
 
-  return expr;
+  const Token *paren = consume(RIGHT_PAREN, "Expect ')' after arguments.");
+
+  return std::make_unique<Call>(std::move(callee), paren, std::move(arguments));
 }
 
-std::unique_ptr<Expr> Parser::unary() {
-  if (match({ BANG, MINUS, NOT })) {
-    const Token* op = previous();
-    std::unique_ptr<Expr> right = unary();
-    return std::make_unique<Unary>(op, std::move(right));
+std::unique_ptr<Expr> Parser::array() {
+  const Token* bracket = previous();
+  std::vector<std::unique_ptr<Expr>> elements;
+
+  if (!check(RIGHT_BRACKET)) {
+    do {
+      elements.push_back(expression());
+    } while (match(COMMA));
   }
 
-  return call();
+  consume(RIGHT_BRACKET, "Expect ']' after array elements.");
+  return std::make_unique<ArrayLiteral>(bracket, std::move(elements));
 }
 
-std::unique_ptr<Expr> Parser::call() {
-  std::unique_ptr<Expr> expr = primary();
+std::unique_ptr<Expr> Parser::map() {
+  const Token* brace = previous();
+  std::vector<std::pair<std::unique_ptr<Expr>, std::unique_ptr<Expr>>> entries;
 
-  while(match({ LEFT_PAREN }))
-    expr = finish_call(std::move(expr));
+  if (!check(RIGHT_BRACE)) {
+    do {
+      std::unique_ptr<Expr> key = expression();
+      consume(COLON, "Expect ':' after map key.");
+      entries.push_back({ std::move(key), expression() });
+    } while (match(COMMA));
+  }
 
-  return expr;
+  consume(RIGHT_BRACE, "Expect '}' after map entries.");
+  return std::make_unique<MapLiteral>(brace, std::move(entries));
 }
 
-std::unique_ptr<Expr> Parser::primary() {
-  if (match({ FALSE }))
-    return std::make_unique<Literal>(false);
-  if (match({ TRUE }))
-    return std::make_unique<Literal>(true);
-  if (match({ NIL }))
-    return std::make_unique<Literal>(nullptr);
-  if (match({ NUMBER }))
-    return std::make_unique<Literal>(std::any_cast<double>(previous()->object));
-  if (match({ STRING }))
-    return std::make_unique<Literal>(std::any_cast<std::string>(previous()->object));
-  if (match({ IDENTIFIER })) return std::make_unique<Variable>(previous());
-
-  if (match({ LEFT_PAREN })) {
-    std::unique_ptr<Expr> expr = expression();
-    consume(RIGHT_PAREN, "Expect ')' after expression.");
-    return std::make_unique<Grouping>(std::move(expr));
-  }
-
-  throw error(peek(), "Expect expression.");
+std::unique_ptr<Expr> Parser::index(std::unique_ptr<Expr> object) {
+  const Token* bracket = previous();
+  std::unique_ptr<Expr> index = expression();
+  consume(RIGHT_BRACKET, "Expect ']' after index.");
+  return std::make_unique<Index>(std::move(object), bracket, std::move(index));
 }
 
 std::unique_ptr<Stmt> Parser::expr_stmt() {
@@ -235,11 +239,11 @@ std::unique_ptr<Stmt> Parser::expr_stmt() {
 
 std::unique_ptr<Stmt> Parser::declaration() {
   try {
-    if (match({ VAR })) return var_declaration();
-    if (match({ FUN })) return func("function");
-    if (match({ IF })) return if_stmt();
-    // if (match({ WHILE })) return while_stmt();
-    // if (match({ FOR })) return for_stmt();
+    if (match(VAR)) return var_declaration();
+    if (match(FUN)) return func("function");
+    if (match(IF)) return if_stmt();
+    // if (match(WHILE)) return while_stmt();
+    // if (match(FOR)) return for_stmt();
     return statement();
   } catch (ParseError error) {
     synchronize();
@@ -255,12 +259,12 @@ std::unique_ptr<Stmt> Parser::var_declaration() {
     const Token* name = previous();
 
     std::unique_ptr<Expr> initializer;
-    if (match({ EQUAL }))
+    if (match(EQUAL))
       initializer = std::move(expression());
     
     variables.push_back({name, std::move(initializer)});
 
-    if (!match({ COMMA }))
+    if (!match(COMMA))
       break;
   }
 
@@ -269,29 +273,43 @@ std::unique_ptr<Stmt> Parser::var_declaration() {
 }
 
 std::unique_ptr<Stmt> Parser::func(const std::string &kind) {
-  consume(IDENTIFIER, "Expect " + kind + " name.");
+  size_t first = current - 1;
+  // messages are only built on the error path
+  if (!match(IDENTIFIER)) throw error(peek(), "Expect " + kind + " name.");
   const Token* name = previous();
-  consume(LEFT_PAREN, "Expect '(' after " + kind + " name.");
+  if (!match(LEFT_PAREN)) throw error(peek(), "Expect '(' after " + kind + " name.");
   std::vector<const Token*> params;
   if (!check(RIGHT_PAREN)) {
     do {
-      if (params.size() >= 255)
+      if (params.size() >= max_args)
         error(peek(), "Can't have more than 255 arguments.");
       consume(IDENTIFIER, "Expect parameter name.");
       const Token* param = previous();
       params.push_back(param);
-    } while (match({ COMMA }));
+    } while (match(COMMA));
   }
-  consume(RIGHT_PAREN, "Expect ')' after " + kind + " parameter list.");
-
-  consume(LEFT_BRACE, "Expect '{' before " + kind + " body.");
-  std::vector<std::unique_ptr<Stmt>> body(std::move(block()));
-  return std::make_unique<Function>(name, params, std::move(body));
+  if (!match(RIGHT_PAREN)) throw error(peek(), "Expect ')' after " + kind + " parameter list.");
+
+  if (!match(LEFT_BRACE)) throw error(peek(), "Expect '{' before " + kind + " body.");
+  std::unique_ptr<Function> function;
+  if (lazy) {
+    size_t start = current;
+    skip_block();
+    function = std::make_unique<Function>(name, std::move(params), std::vector<std::unique_ptr<Stmt>>());
+    function->lazy = std::make_unique<LazyBody>(tokens, start);
+  } else {
+    std::vector<std::unique_ptr<Stmt>> body(std::move(block()));
+    function = std::make_unique<Function>(name, std::move(params), std::move(body));
+  }
+  function->first = first;
+  function->last = current - 1;
+  return function;
 }
 
 std::unique_ptr<Stmt> Parser::statement() {
-  if (match({ LEFT_BRACE })) return std::make_unique<Block>(std::move(block()));
-  if (match({ RETURN })) return return_stmt();
+  if (match(LEFT_BRACE)) return std::make_unique<Block>(std::move(block()));
+  if (match(RETURN)) return return_stmt();
+  if (match(YIELD)) return yield_stmt();
   return expr_stmt();
 }
 
@@ -302,7 +320,7 @@ std::unique_ptr<Stmt> Parser::if_stmt() {
 
   std::unique_ptr<Stmt> then_branch = statement();
   std::unique_ptr<Stmt> else_branch;
-  if (match({ ELSE }))
+  if (match(ELSE))
     else_branch = statement();
   
   return std::make_unique<If>(std::move(expr), std::move(then_branch), std::move(else_branch));
@@ -319,6 +337,17 @@ std::unique_ptr<Stmt> Parser::return_stmt() {
   return std::make_unique<Return>(keyword, std::move(value));
 }
 
+std::unique_ptr<Stmt> Parser::yield_stmt() {
+  const Token* keyword = previous();
+  std::unique_ptr<Expr> value = nullptr;
+
+  if (!check(SEMICOLON))
+      value = expression();
+
+  consume(SEMICOLON, "Expect ';' after 'yield' value.");
+  return std::make_unique<Yield>(keyword, std::move(value));
+}
+
 std::vector<std::unique_ptr<Stmt>> Parser::block() {
   std::vector<std::unique_ptr<Stmt>> statements;
 
@@ -329,6 +358,43 @@ std::vector<std::unique_ptr<Stmt>> Parser::block() {
   return statements;
 }
 
+void Parser::skip_block() {
+  for (size_t depth = 1; !at_end(); advance()) {
+    if (check(LEFT_BRACE)) depth++;
+    if (check(RIGHT_BRACE) && --depth == 0) break;
+  }
+  consume(RIGHT_BRACE, "Expect '}' after block.");
+}
+
+// the statements of a function, parsing a lazily skipped body on first use.
+// syntax errors found then surface as a RuntimeError at the call
+const std::vector<std::unique_ptr<Stmt>>& Parser::body(const Function& function) {
+  if (!function.lazy)
+    return function.body;
+
+  LazyBody& lazy = *function.lazy;
+  std::call_once(lazy.parsed, [&function, &lazy] {
+    std::ostringstream diagnostics;
+    owo reporter(diagnostics);
+    if (!lazy.source.empty()) {
+      Scanner scanner(lazy.source, reporter, lazy.line);
+      scanner.scan_tokens();
+      lazy.scanned = scanner.release();
+    }
+    Parser parser(*lazy.tokens, reporter, true);
+    parser.current = lazy.start;
+
+    std::vector<std::unique_ptr<Stmt>> body = parser.block();
+    if (reporter.failed()) {
+      std::string message = diagnostics.str();
+      message.pop_back();
+      throw RuntimeError(message, function.name);
+    }
+    lazy.body = std::move(body);
+  });
+  return lazy.body;
+}
+
 const std::vector<std::unique_ptr<Stmt>> &Parser::parse() {
   statements.clear();
 
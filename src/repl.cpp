@@ -0,0 +1,62 @@
+#include <repl>
+#include <script>
+#include <iostream>
+
+Repl::Repl(owo& session) : session(session), evaluator(session), checker(diagnostics, session.options()) {
+  evaluator.set_mode(1);
+}
+
+Repl::~Repl() = default;
+
+void Repl::run(std::istream& in) {
+  std::ostream& out = session.output();
+  std::string line;
+  while (true) {
+    out << (pending.empty() ? ">>> " : "... ");
+    bool end = !std::getline(in, line);
+    if (!end && pending.empty() && line == "exit")
+      break;
+
+    // script errors are reported by the interpreter; anything else, like a
+    // stack that couldn't be mapped, still has to reach the user
+    try {
+      if (!end)
+        feed(line);
+      else if (!pending.empty())
+        submit(true);
+    } catch (const std::runtime_error& error) {
+      std::cerr << error.what() << std::endl;
+    }
+    if (end) {
+      out << std::endl;
+      break;
+    }
+  }
+}
+
+bool Repl::feed(const std::string& line) {
+  if (pending.empty() && line.empty())
+    return true;
+  bool force = line.empty();
+  pending += line;
+  pending += '\n';
+  submit(force);
+  return pending.empty();
+}
+
+void Repl::submit(bool force) {
+  checker.reset_error();
+  diagnostics.str("");
+  auto script = std::make_unique<Script>(pending, checker);
+  if (!script->valid()) {
+    if (checker.incomplete() && !force)
+      return;
+    session.output() << diagnostics.str();
+    pending.clear();
+    return;
+  }
+
+  pending.clear();
+  evaluator.interpret(script->statements());
+  scripts.push_back(std::move(script));
+}
@@ -1,8 +1,12 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <map>
 #include <owo>
 #include <scanner>
 
-std::map<std::string, TokenType> keywords{
+// read-only after static init, safe to share between threads
+const std::map<std::string, TokenType> keywords{
   { "if", IF },
   { "for", FOR },
   { "fun", FUN },
@@ -21,9 +25,10 @@ std::map<std::string, TokenType> keywords{
   { "super", SUPER },
   { "while", WHILE },
   { "return", RETURN },
+  { "yield", YIELD },
 };
 
-Scanner::Scanner(const std::string& source) : source(source) {}
+Scanner::Scanner(const std::string& source, owo& reporter, size_t line) : source(source), reporter(reporter), line(line) {}
 
 std::string Scanner::get(size_t i, size_t j) { return source.substr(i, j-i); }
 bool Scanner::at_end() { return current >= source.size(); }
@@ -50,7 +55,7 @@ void Scanner::string() {
     }
 
     if (at_end()) {
-        owo::error(line, "Unterminated string");
+        reporter.error_at_end(line, "Unterminated string");
         return;
     }
 
@@ -60,15 +65,23 @@ void Scanner::string() {
 }
 
 void Scanner::number() {
+    bool integral = true;
     while (is_digit(peek())) advance();
 
     if (peek() == '.' && is_digit(peek_next())) {
+        integral = false;
         advance();
         while (is_digit(peek())) advance();
     }
 
+    // integer literals too long for int64 start out as doubles
     std::string value = get(start, current);
-    add_token(NUMBER, std::stod(value));
+    errno = 0;
+    long long integer = integral ? std::strtoll(value.c_str(), nullptr, 10) : 0;
+    if (integral && errno != ERANGE)
+        add_token(NUMBER, static_cast<int64_t>(integer));
+    else
+        add_token(NUMBER, std::stod(value));
 }
 
 void Scanner::identifier() {
@@ -87,6 +100,8 @@ void Scanner::scan_token() {
     case ')': return add_token(RIGHT_PAREN);
     case '{': return add_token(LEFT_BRACE);
     case '}': return add_token(RIGHT_BRACE);
+    case '[': return add_token(LEFT_BRACKET);
+    case ']': return add_token(RIGHT_BRACKET);
     case ',': return add_token(COMMA);
     case '.': return add_token(DOT);
     case '-': return add_token(MINUS);
@@ -123,7 +138,7 @@ void Scanner::scan_token() {
     default:
         if (is_digit(c)) return number();
         else if (is_alpha(c)) return identifier();
-        owo::error(line, "Unexpected character: " + std::string(1, c));
+        reporter.error(line, "Unexpected character: " + std::string(1, c));
         return;
     }
 }
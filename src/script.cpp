@@ -0,0 +1,8 @@
+#include <script>
+#include <owo>
+
+Script::Script(const std::string& source, owo& reporter)
+  : scanner(source, reporter), scanned(scanner.scan_tokens()), parser(scanned, reporter, reporter.options().lazy_parse) {
+  stmts = &parser.parse();
+  ok = !reporter.failed();
+}
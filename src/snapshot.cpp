@@ -0,0 +1,326 @@
+#include <snapshot>
+#include <owo>
+#include <script>
+#include <parser>
+#include <callable-function>
+#include <typed-array>
+#include <hash-map>
+#include <generator>
+#include <file>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+static const char header[] = "owo snapshot 1\n";
+
+// functions reachable from a value, each array and map visited once
+static void reach(const std::any& value, const Environment* globals, std::unordered_set<const GcObject*>& seen, std::vector<const Function*>& found) {
+  if (const CallableFunction* function = std::any_cast<CallableFunction>(&value)) {
+    if (function->closure.get() != globals)
+      throw std::runtime_error("Can't snapshot function '" + function->declaration.name->lexeme + "': only top-level functions can be saved.");
+    found.push_back(&function->declaration);
+  } else if (const array_t* array = std::any_cast<array_t>(&value)) {
+    if (!seen.insert(array->get()).second) return;
+    for (size_t i = 0; i < (*array)->size(); ++i)
+      reach((*array)->get(i), globals, seen, found);
+  } else if (const map_t* map = std::any_cast<map_t>(&value)) {
+    if (!seen.insert(map->get()).second) return;
+    (*map)->each([&](const std::any&, const std::any& entry) { reach(entry, globals, seen, found); });
+  }
+}
+
+// the body of a declaration parsed from script: its tokens from the "{" on,
+// joined by spaces and on the lines they came from relative to the first
+static std::string source(const Function& declaration, const Script& script, int& line) {
+  const std::vector<std::unique_ptr<Token>>& tokens = script.tokens();
+  if (declaration.first + 1 >= tokens.size() || tokens[declaration.first + 1].get() != declaration.name)
+    throw std::runtime_error("Can't snapshot function '" + declaration.name->lexeme + "': its source is gone.");
+
+  size_t t = declaration.first;
+  while (tokens[t]->type != LEFT_BRACE) ++t;
+  line = tokens[t]->line;
+
+  std::string text;
+  int at = line;
+  for (; t <= declaration.last; ++t) {
+    const Token& token = *tokens[t];
+    // a string token carries the line it ends on
+    int newlines = std::count(token.lexeme.begin(), token.lexeme.end(), '\n');
+    int target = token.line - newlines;
+    if (target > at) {
+      text.append(target - at, '\n');
+      at = target;
+    } else if (!text.empty()) {
+      text += ' ';
+    }
+    text += token.lexeme;
+    at += newlines;
+  }
+  return text;
+}
+
+struct Writer {
+  std::unordered_map<const Function*, size_t> functions;
+  // arrays and maps in the order they were first written, which is also the
+  // order the reader creates them in
+  std::unordered_map<const GcObject*, size_t> objects;
+  std::string out;
+
+  void value(const std::any& value) {
+    if (const int64_t* integer = std::any_cast<int64_t>(&value)) {
+      out += "i " + std::to_string(*integer);
+    } else if (const double* real = std::any_cast<double>(&value)) {
+      // hex floats round-trip exactly
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%a", *real);
+      out += "d ";
+      out += buffer;
+    } else if (const std::string* string = std::any_cast<std::string>(&value)) {
+      out += "s " + std::to_string(string->size()) + " " + *string;
+    } else if (const bool* boolean = std::any_cast<bool>(&value)) {
+      out += *boolean ? "t" : "f";
+    } else if (const CallableFunction* function = std::any_cast<CallableFunction>(&value)) {
+      out += "c " + std::to_string(functions.at(&function->declaration));
+    } else if (const array_t* array = std::any_cast<array_t>(&value)) {
+      if (object(array->get())) return;
+      out += "a " + std::to_string((*array)->size());
+      for (size_t i = 0; i < (*array)->size(); ++i) {
+        out += ' ';
+        this->value((*array)->get(i));
+      }
+    } else if (const map_t* map = std::any_cast<map_t>(&value)) {
+      if (object(map->get())) return;
+      out += "m " + std::to_string((*map)->size());
+      (*map)->each([this](const std::any& key, const std::any& entry) {
+        out += ' ';
+        this->value(key);
+        out += ' ';
+        this->value(entry);
+      });
+    } else if (value.type() == typeid(generator_t)) {
+      throw std::runtime_error("Can't snapshot a generator.");
+    } else if (value.type() == typeid(file_t)) {
+      throw std::runtime_error("Can't snapshot a file.");
+    } else if (value.type() == typeid(Callable)) {
+      throw std::runtime_error("Can't snapshot a native function outside the global it is defined as.");
+    } else {
+      out += "n";
+    }
+  }
+
+  // writes a reference to an object seen before, or numbers a new one
+  bool object(const GcObject* object) {
+    auto [it, added] = objects.emplace(object, objects.size());
+    if (!added)
+      out += "r " + std::to_string(it->second);
+    return !added;
+  }
+};
+
+struct Cursor {
+  const char* at;
+  const char* end;
+
+  [[noreturn]] static void invalid() {
+    throw std::runtime_error("Invalid snapshot.");
+  }
+
+  // false at the end of the data
+  bool skip() {
+    while (at < end && (*at == ' ' || *at == '\n')) ++at;
+    return at < end;
+  }
+
+  char tag() {
+    if (!skip()) invalid();
+    return *at++;
+  }
+
+  std::string word() {
+    skip();
+    const char* start = at;
+    while (at < end && *at != ' ' && *at != '\n') ++at;
+    if (at == start) invalid();
+    return std::string(start, at);
+  }
+
+  int64_t integer() {
+    std::string digits = word();
+    char* stop;
+    errno = 0;
+    int64_t integer = std::strtoll(digits.c_str(), &stop, 10);
+    if (*stop || errno) invalid();
+    return integer;
+  }
+
+  size_t count() {
+    int64_t n = integer();
+    if (n < 0) invalid();
+    return n;
+  }
+
+  // size bytes after the single space that follows a length
+  std::string bytes(size_t size) {
+    if (at == end || static_cast<size_t>(end - ++at) < size) invalid();
+    std::string bytes(at, size);
+    at += size;
+    return bytes;
+  }
+};
+
+struct Reader : Cursor {
+  Interpreter& interpreter;
+  const std::shared_ptr<Environment>& globals;
+  const std::vector<std::unique_ptr<Function>>& functions;
+  std::vector<std::any> objects;
+
+  Reader(const char* at, const char* end, Interpreter& interpreter, const std::vector<std::unique_ptr<Function>>& functions)
+    : Cursor{at, end}, interpreter(interpreter), globals(interpreter.global_scope()), functions(functions) {}
+
+  std::any value() {
+    switch (tag()) {
+    case 'n': return nullptr;
+    case 't': return true;
+    case 'f': return false;
+    case 'i': return integer();
+    case 'd': {
+      std::string digits = word();
+      char* stop;
+      double real = std::strtod(digits.c_str(), &stop);
+      if (*stop) invalid();
+      return real;
+    }
+    case 's': return bytes(count());
+    case 'c': {
+      size_t index = count();
+      if (index >= functions.size()) invalid();
+      return CallableFunction(*functions[index], globals);
+    }
+    case 'a': {
+      size_t size = count();
+      array_t array = interpreter.heap.make<Array>();
+      objects.push_back(array);
+      for (size_t i = 0; i < size; ++i)
+        array->push(value());
+      return array;
+    }
+    case 'm': {
+      size_t size = count();
+      map_t map = interpreter.heap.make<HashMap>();
+      objects.push_back(map);
+      for (size_t i = 0; i < size; ++i) {
+        std::any key = value();
+        uint64_t hash;
+        if (!HashMap::hash(key, hash)) invalid();
+        map->set(key, hash, value());
+      }
+      return map;
+    }
+    case 'r': {
+      size_t index = count();
+      if (index >= objects.size()) invalid();
+      return objects[index];
+    }
+    }
+    invalid();
+  }
+};
+
+Snapshot::Snapshot(const std::string& path, owo& session) : data(owo::read_file(path)) {
+  const size_t header_size = sizeof(header) - 1;
+  if (data.compare(0, header_size, header))
+    throw std::runtime_error("Not an owo snapshot: " + path);
+
+  Cursor reader{data.data() + header_size, data.data() + data.size()};
+  if (reader.word() != "functions") Cursor::invalid();
+  size_t n = reader.count();
+  // hot functions get compiled on their next call instead of a full
+  // threshold later; the counter only triggers on reaching it exactly
+  uint32_t hot = std::max(1u, session.options().jit_threshold) - 1;
+  for (size_t i = 0; i < n; ++i) {
+    std::string name = reader.word();
+    int line = reader.count();
+    uint64_t calls = reader.count();
+    tokens.push_back(std::make_unique<Token>(IDENTIFIER, name, nullptr, line));
+    const Token* name_token = tokens.back().get();
+    size_t arity = reader.count();
+    if (arity > Parser::max_args) Cursor::invalid();
+    std::vector<const Token*> params(arity);
+    for (const Token*& param : params) {
+      tokens.push_back(std::make_unique<Token>(IDENTIFIER, reader.word(), nullptr, line));
+      param = tokens.back().get();
+    }
+    std::string body = reader.bytes(reader.count());
+    if (body.empty() || body[0] != '{') Cursor::invalid();
+
+    // nothing of the body is scanned until its first call
+    auto function = std::make_unique<Function>(name_token, std::move(params), std::vector<std::unique_ptr<Stmt>>());
+    function->lazy = std::make_unique<LazyBody>(std::move(body), line);
+    function->calls.store(std::min<uint64_t>(calls, hot), std::memory_order_relaxed);
+    functions.push_back(std::move(function));
+  }
+
+  if (reader.word() != "globals") Cursor::invalid();
+  values = reader.at - data.data();
+}
+
+Snapshot::~Snapshot() = default;
+
+void Snapshot::restore(Interpreter& interpreter) const {
+  Reader reader(data.data() + values, data.data() + data.size(), interpreter, functions);
+  while (reader.skip()) {
+    std::string name = reader.word();
+    reader.globals->define(name, reader.value(), nullptr);
+  }
+}
+
+void Snapshot::save(const std::string& path, owo& session, Interpreter& interpreter, const Script& script) {
+  const std::shared_ptr<Environment>& globals = interpreter.global_scope();
+
+  std::unordered_set<const GcObject*> seen;
+  std::vector<const Function*> found;
+  globals->each([&](const std::string&, const std::any& value) { reach(value, globals.get(), seen, found); });
+
+  Writer writer;
+  std::string section;
+  for (const Function* function : found) {
+    if (!writer.functions.emplace(function, writer.functions.size()).second)
+      continue;
+    const Function& declaration = *function;
+    int line;
+    std::string body;
+    if (declaration.lazy && !declaration.lazy->source.empty()) {
+      line = declaration.lazy->line;
+      body = declaration.lazy->source;
+    } else {
+      body = source(declaration, script, line);
+    }
+    section += declaration.name->lexeme + " " + std::to_string(line) + " " + std::to_string(declaration.calls.load(std::memory_order_relaxed));
+    section += " " + std::to_string(declaration.params.size());
+    for (const Token* param : declaration.params)
+      section += " " + param->lexeme;
+    section += " " + std::to_string(body.size()) + "\n" + body + "\n";
+  }
+
+  // natives are kept by name and come from the loading interpreter
+  Interpreter fresh(session);
+  globals->each([&](const std::string& name, const std::any& value) {
+    if (value.type() == typeid(Callable)) {
+      if (!fresh.global_scope()->find(name))
+        throw std::runtime_error("Can't snapshot '" + name + "': it holds a native function under another name.");
+      return;
+    }
+    writer.out += name + " ";
+    writer.value(value);
+    writer.out += '\n';
+  });
+
+  std::ofstream file(path, std::ios::binary);
+  file << header << "functions " << writer.functions.size() << "\n" << section << "globals\n" << writer.out;
+  if (!file)
+    throw std::runtime_error("Failed to write snapshot: " + path);
+}
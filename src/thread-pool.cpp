@@ -0,0 +1,97 @@
+#include <thread-pool>
+
+// index of the pool worker running on this thread, used so tasks submitted
+// from inside a task land on the submitting worker's own deque
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+ThreadPool::ThreadPool(size_t n_threads) {
+  if (n_threads == 0) n_threads = 1;
+  for (size_t i = 0; i < n_threads; ++i)
+    queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < n_threads; ++i)
+    workers.emplace_back([this, i] { worker_loop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  task_ready.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+void ThreadPool::submit(task_t task) {
+  size_t index;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    index = current_pool == this ? current_index : next_queue++ % queues.size();
+    pending++;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(queues[index]->lock);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queued++;
+  }
+  task_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> guard(lock);
+  all_done.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::pop(size_t index, task_t& task) {
+  Queue& queue = *queues[index];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if (queue.tasks.empty()) return false;
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::steal(size_t index, task_t& task) {
+  for (size_t i = 1; i < queues.size(); ++i) {
+    Queue& victim = *queues[(index + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.tasks.empty()) continue;
+    task = std::move(victim.tasks.front());
+    victim.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+  current_pool = this;
+  current_index = index;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      task_ready.wait(guard, [this] { return stopping || queued > 0; });
+      if (queued == 0) return;
+      queued--;
+    }
+
+    // a task is reserved for us; it is either in our deque or stealable
+    task_t task;
+    while (!pop(index, task) && !steal(index, task))
+      std::this_thread::yield();
+
+    task();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (--pending == 0)
+      all_done.notify_all();
+  }
+}
@@ -1,5 +1,10 @@
 #include <token>
 #include <callable-function>
+#include <typed-array>
+#include <hash-map>
+#include <generator>
+#include <file>
+#include <algorithm>
 
 std::string token_type_to_string(TokenType type) {
   switch (type) {
@@ -7,6 +12,8 @@ std::string token_type_to_string(TokenType type) {
     case RIGHT_PAREN: return "RIGHT_PAREN";
     case LEFT_BRACE: return "LEFT_BRACE";
     case RIGHT_BRACE: return "RIGHT_BRACE";
+    case LEFT_BRACKET: return "LEFT_BRACKET";
+    case RIGHT_BRACKET: return "RIGHT_BRACKET";
     case COMMA: return "COMMA";
     case NOT: return "NOT";
     case PLUS: return "PLUS";
@@ -55,6 +62,7 @@ std::string token_type_to_string(TokenType type) {
     case XOR: return "XOR";
     case BREAK: return "BREAK";
     case CONTINUE: return "CONTINUE";
+    case YIELD: return "YIELD";
     
     case OWO_EOF: return "OWO_EOF";
 
@@ -68,21 +76,59 @@ Token::Token() : type(OWO_EOF), lexeme(""), object(nullptr), line(0) {}
 Token::Token(TokenType type, std::string lexeme, std::any object, int line)
   : type(type), lexeme(lexeme), object(object), line(line) {}
 
-std::ostream& operator<<(std::ostream& out, const std::any& obj) {
+// path holds the containers being printed around obj, so one that
+// contains itself prints as a placeholder instead of recursing forever
+static void write(std::ostream& out, const std::any& obj, std::vector<const void*>& path) {
   if (obj.has_value()) {
     try {
       if (obj.type() == typeid(std::string)) {
         out << std::any_cast<std::string>(obj);
       } else if (obj.type() == typeid(double)) {
         out << std::any_cast<double>(obj);
-      } else if (obj.type() == typeid(int)) {
-        out << std::any_cast<int>(obj);
+      } else if (obj.type() == typeid(int64_t)) {
+        out << std::any_cast<int64_t>(obj);
       } else if (obj.type() == typeid(bool)) {
         out << (std::any_cast<bool>(obj) ? "true" : "false");
       } else if (obj.type() == typeid(Callable)) {
         out << std::any_cast<Callable>(obj).to_string();
       } else if (obj.type() == typeid(CallableFunction)) {
         out << std::any_cast<CallableFunction>(obj).to_string();
+      } else if (obj.type() == typeid(array_t)) {
+        const Array& array = *std::any_cast<const array_t&>(obj);
+        if (std::find(path.begin(), path.end(), &array) != path.end()) {
+          out << "[...]";
+          return;
+        }
+        path.push_back(&array);
+        out << "[";
+        for (size_t i = 0; i < array.size(); ++i) {
+          out << (i ? ", " : "");
+          write(out, array.get(i), path);
+        }
+        out << "]";
+        path.pop_back();
+      } else if (obj.type() == typeid(map_t)) {
+        const HashMap& map = *std::any_cast<const map_t&>(obj);
+        if (std::find(path.begin(), path.end(), &map) != path.end()) {
+          out << "{...}";
+          return;
+        }
+        path.push_back(&map);
+        bool first = true;
+        out << "{";
+        map.each([&](const std::any& key, const std::any& value) {
+          out << (first ? "" : ", ");
+          write(out, key, path);
+          out << ": ";
+          write(out, value, path);
+          first = false;
+        });
+        out << "}";
+        path.pop_back();
+      } else if (obj.type() == typeid(generator_t)) {
+        out << "<generator>";
+      } else if (obj.type() == typeid(file_t)) {
+        out << "<file " << std::any_cast<const file_t&>(obj)->name() << ">";
       } else {
         out << "nil";
       }
@@ -92,7 +138,11 @@ std::ostream& operator<<(std::ostream& out, const std::any& obj) {
   } else {
     out << "<none>";
   }
+}
 
+std::ostream& operator<<(std::ostream& out, const std::any& obj) {
+  std::vector<const void*> path;
+  write(out, obj, path);
   return out;
 }
 
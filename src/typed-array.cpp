@@ -0,0 +1,144 @@
+#include <typed-array>
+#include <number>
+
+// an integer that converts to a double and back unchanged
+static bool representable(int64_t integer) {
+  int64_t back;
+  return exact_integer(static_cast<double>(integer), back) && back == integer;
+}
+
+bool Array::fits(const std::any& value) {
+  Storage wanted = value.type() == typeid(int64_t) ? INTEGERS : value.type() == typeid(double) ? REALS : BOXED;
+  if (wanted == storage)
+    return true;
+  if (storage != BOXED && !size()) {
+    storage = wanted;
+    whole.clear();
+    return true;
+  }
+  if (storage == REALS && wanted == INTEGERS)
+    return representable(std::any_cast<int64_t>(value));
+  if (storage == INTEGERS && wanted == REALS)
+    return widen();
+  return false;
+}
+
+// integers to doubles, marked as integers, when each converts exactly
+bool Array::widen() {
+  for (int64_t integer : integers)
+    if (!representable(integer)) return false;
+  reals.reserve(integers.capacity());
+  reals.assign(integers.begin(), integers.end());
+  whole.assign(integers.size(), true);
+  integers = std::vector<int64_t>();
+  storage = REALS;
+  account();
+  return true;
+}
+
+void Array::box() {
+  if (storage == INTEGERS) {
+    values.reserve(integers.capacity());
+    for (int64_t integer : integers)
+      values.emplace_back(integer);
+  } else if (storage == REALS) {
+    values.reserve(reals.capacity());
+    for (size_t i = 0; i < reals.size(); ++i)
+      values.push_back(get(i));
+  }
+  integers = std::vector<int64_t>();
+  reals = std::vector<double>();
+  whole = std::vector<bool>();
+  storage = BOXED;
+}
+
+void Array::mark(size_t i, bool integer) {
+  if (whole.empty() && !integer)
+    return;
+  if (whole.size() < reals.size())
+    whole.resize(reals.size());
+  whole[i] = integer;
+}
+
+void Array::account() {
+  resize(sizeof(Array) + integers.capacity() * sizeof(int64_t) + reals.capacity() * sizeof(double)
+    + whole.capacity() / 8 + values.capacity() * sizeof(std::any));
+}
+
+size_t Array::size() const {
+  switch (storage) {
+  case INTEGERS: return integers.size();
+  case REALS: return reals.size();
+  default: return values.size();
+  }
+}
+
+std::any Array::get(size_t i) const {
+  switch (storage) {
+  case INTEGERS: return integers[i];
+  case REALS:
+    if (!whole.empty() && whole[i]) return static_cast<int64_t>(reals[i]);
+    return reals[i];
+  default: return values[i];
+  }
+}
+
+void Array::set(size_t i, const std::any& value) {
+  if (!fits(value)) {
+    box();
+    account();
+  }
+  switch (storage) {
+  case INTEGERS: integers[i] = std::any_cast<int64_t>(value); break;
+  case REALS: {
+    const int64_t* integer = std::any_cast<int64_t>(&value);
+    reals[i] = integer ? static_cast<double>(*integer) : std::any_cast<double>(value);
+    mark(i, integer);
+    break;
+  }
+  default: values[i] = value;
+  }
+}
+
+void Array::push(std::any value) {
+  if (!fits(value))
+    box();
+  size_t capacity = integers.capacity() + reals.capacity() + values.capacity();
+  switch (storage) {
+  case INTEGERS: integers.push_back(std::any_cast<int64_t>(value)); break;
+  case REALS: {
+    const int64_t* integer = std::any_cast<int64_t>(&value);
+    reals.push_back(integer ? static_cast<double>(*integer) : std::any_cast<double>(value));
+    mark(reals.size() - 1, integer);
+    break;
+  }
+  default: values.push_back(std::move(value));
+  }
+  if (integers.capacity() + reals.capacity() + values.capacity() != capacity)
+    account();
+}
+
+std::any Array::pop() {
+  std::any last = get(size() - 1);
+  switch (storage) {
+  case INTEGERS: integers.pop_back(); break;
+  case REALS:
+    reals.pop_back();
+    if (whole.size() > reals.size()) whole.pop_back();
+    break;
+  default: values.pop_back();
+  }
+  return last;
+}
+
+void Array::trace(const visit_t& visit) const {
+  for (const std::any& value : values)
+    trace_value(value, visit);
+}
+
+void Array::clear() {
+  integers.clear();
+  reals.clear();
+  whole.clear();
+  values.clear();
+}
@@ -0,0 +1,56 @@
+#include <worker-pool>
+#include <sstream>
+#include <script>
+#include <owo>
+
+static void execute(const Script& script, const Options& options, RunResult& result) {
+  std::ostringstream out;
+  owo session(out, options);
+  Interpreter interpreter(session);
+
+  try {
+    interpreter.interpret(script.statements());
+  } catch (const std::runtime_error& error) {
+    out << error.what() << std::endl;
+    result.status = 70;
+  }
+  if (session.runtime_failed())
+    result.status = session.budget_failed() ? 75 : 70;
+  result.output = out.str();
+}
+
+WorkerPool::WorkerPool(size_t n_threads, const Options& options) : pool(n_threads), options(options) {}
+
+size_t WorkerPool::size() const { return pool.size(); }
+
+std::vector<RunResult> WorkerPool::run(const std::vector<std::string>& sources) {
+  std::vector<RunResult> results(sources.size());
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    pool.submit([this, &sources, &results, i] {
+      std::ostringstream diagnostics;
+      owo reporter(diagnostics);
+      Script script(sources[i], reporter);
+
+      if (!script.valid()) {
+        results[i].output = diagnostics.str();
+        results[i].status = 64;
+        return;
+      }
+      execute(script, options, results[i]);
+    });
+  }
+
+  pool.wait();
+  return results;
+}
+
+std::vector<RunResult> WorkerPool::run(const Script& script, size_t invocations) {
+  std::vector<RunResult> results(invocations);
+
+  for (size_t i = 0; i < invocations; ++i)
+    pool.submit([this, &script, &results, i] { execute(script, options, results[i]); });
+
+  pool.wait();
+  return results;
+}
@@ -5,11 +5,52 @@ HEADERS_EXPR = """#pragma once
 #include <token>
 #include <vector>
 #include <memory>
+#include <atomic>
+
+// type feedback of self-specializing nodes. nodes are shared between
+// interpreters on different threads, so the state is atomic and only ever
+// moves forward: UNSPECIALIZED -> one specialized state -> GENERIC, with
+// MONOMORPHIC -> INLINED as the one step between specialized states
+enum Specialization : uint8_t {
+  UNSPECIALIZED,
+  NUMERIC,         // Binary: both operands have been numbers
+  BOOLEAN,         // If: condition has been a bool
+  CONSTANT_TRUE,   // If: condition is a truthy literal
+  CONSTANT_FALSE,  // If: condition is a falsy literal
+  MONOMORPHIC,     // Call: one function declaration has been called
+  INLINED,         // Call: that declaration's body is evaluated in place
+  COMPILED,        // Function: body has native code
+  GENERIC
+};
+
+struct Function;
 
 """
 
 HEADERS_STMT = """#pragma once
 #include <expr>
+#include <mutex>
+
+struct Stmt;
+
+// token range of a function body the parser only brace-matched, or the
+// source of one loaded from a snapshot, from its "{" on the given line; the
+// body is scanned and parsed on the first call
+struct LazyBody {
+	const std::vector<std::unique_ptr<Token>>* tokens;
+	const size_t start;
+	const std::string source;
+	const int line = 0;
+	std::vector<std::unique_ptr<Token>> scanned;
+	std::once_flag parsed;
+	std::vector<std::unique_ptr<Stmt>> body;
+
+	LazyBody(const std::vector<std::unique_ptr<Token>>& tokens, size_t start)
+		: tokens(&tokens), start(start) {};
+	LazyBody(std::string source, int line)
+		: tokens(&scanned), start(1), source(std::move(source)), line(line) {};
+};
+
 """
 
 exprs = {
@@ -20,7 +61,12 @@ exprs = {
   "Unary": [("Token*", "op"), ("std::unique_ptr<Expr>", "right")],
   "Call": [("std::unique_ptr<Expr>", "callee"), ("Token*", "paren"), ("std::vector<std::unique_ptr<Expr>>", "args")],
   "Variable": [("Token*", "label")],
-  "Ternary": [("std::unique_ptr<Expr>", "condition"), ("std::unique_ptr<Expr>", "true_case"), ("std::unique_ptr<Expr>", "false_case")]
+  "Ternary": [("std::unique_ptr<Expr>", "condition"), ("std::unique_ptr<Expr>", "true_case"), ("std::unique_ptr<Expr>", "false_case")],
+  "ArrayLiteral": [("Token*", "bracket"), ("std::vector<std::unique_ptr<Expr>>", "elements")],
+  "Index": [("std::unique_ptr<Expr>", "object"), ("Token*", "bracket"), ("std::unique_ptr<Expr>", "index")],
+  "MapLiteral": [("Token*", "brace"), ("std::vector<std::pair<std::unique_ptr<Expr>, std::unique_ptr<Expr>>>", "entries")],
+  # target is always an Index
+  "IndexAssign": [("std::unique_ptr<Expr>", "target"), ("std::unique_ptr<Expr>", "value")]
 }
 
 stmts = {
@@ -28,15 +74,30 @@ stmts = {
   "Var": [("std::vector<std::pair<const Token*, std::unique_ptr<Expr>>>", "variables")],
   "Function": [("Token*", "name"), ("std::vector<const Token*>", "params"), ("std::vector<std::unique_ptr<Stmt>>", "body")],
   "Return": [("Token*", "keyword"), ("std::unique_ptr<Expr>", "value")],
+  "Yield": [("Token*", "keyword"), ("std::unique_ptr<Expr>", "value")],
   "Block": [("std::vector<std::unique_ptr<Stmt>>", "statements")],
   "If": [("std::unique_ptr<Expr>", "condition"), ("std::unique_ptr<Stmt>", "if_case"), ("std::unique_ptr<Stmt>", "else_case")]
 }
 
+# execution state owned by the node but not set by the parser
+profiles = {
+  "Binary": [("std::atomic<Specialization>", "state", "UNSPECIALIZED")],
+  # (epoch << 16) | (hops + 1) of the last successful lookup, 0 when unresolved
+  "Variable": [("std::atomic<uint64_t>", "slot", "0")],
+  "Call": [("std::atomic<Specialization>", "state", "UNSPECIALIZED"), ("std::atomic<const Function*>", "target", "nullptr")],
+  "If": [("std::atomic<Specialization>", "state", "UNSPECIALIZED")],
+  # call count until the JIT looks at the body, and its native entry points
+  # for calls with double and with int64_t arguments. first and last index
+  # the "fun" and closing brace tokens, for writing the source back out
+  "Function": [("std::atomic<uint32_t>", "calls", "0"), ("std::atomic<Specialization>", "state", "UNSPECIALIZED"), ("std::atomic<void*>", "native", "nullptr"), ("std::atomic<void*>", "integer_native", "nullptr"), ("std::unique_ptr<LazyBody>", "lazy", "nullptr"), ("size_t", "first", "0"), ("size_t", "last", "0")]
+}
+
 move_f: Callable[[str], str] = lambda s: f"std::move({s})"
 special_param = {
   "std::unique_ptr<Expr>": move_f,
   "std::unique_ptr<Token>": move_f,
   "std::vector<std::unique_ptr<Expr>>": move_f,
+  "std::vector<std::pair<std::unique_ptr<Expr>, std::unique_ptr<Expr>>>": move_f,
   "std::vector<std::pair<const Token*, std::unique_ptr<Expr>>>": move_f,
   "std::unique_ptr<Stmt>": move_f,
   "std::vector<const Token*>": move_f,
@@ -73,7 +134,7 @@ def define_visitor(name: str, to_visit: List[str]):
 
   return source
 
-def define_types(name: str, types: Dict[str, List[Member]]):
+def define_types(name: str, types: Dict[str, List[Member]], profiles: Dict[str, List[Tuple[str, str, str]]] = {}):
   def handle_param(m_type: str, m_name: str) -> str:
     return special_param.get(m_type, lambda s: s)(m_name)
   
@@ -95,7 +156,8 @@ def define_types(name: str, types: Dict[str, List[Member]]):
   for tn, members in types.items():
     source += f"struct {tn} : {name} {{\n"
     #defining type in class
-    source += "\n".join(f"\tconst {m_type} {m_name};" for m_type, m_name in members) + "\n\n"
+    source += "\n".join(f"\tconst {m_type} {m_name};" for m_type, m_name in members) + "\n"
+    source += "".join(f"\t{p_type} {p_name}{{{p_init}}};\n" for p_type, p_name, p_init in profiles.get(tn, [])) + "\n"
     # defining constructor parameters
     source += f"\t{tn}({", ".join(f"{handle_constructor_t(m_type)} {m_name}" for m_type, m_name in members)})"
     # defining member init list
@@ -116,7 +178,7 @@ def main(args: list[str]):
 
   source += define_types_decl(list(exprs.keys()))
   source += define_visitor("Expr", list(exprs.keys()))
-  source += define_types("Expr", exprs)
+  source += define_types("Expr", exprs, profiles)
 
   with open(f"{os.getcwd()}/{include_dir}/expr", "w") as f:
     f.write(source)
@@ -125,7 +187,7 @@ def main(args: list[str]):
 
   source += define_types_decl(list(stmts.keys()))
   source += define_visitor("Stmt", list(stmts.keys()))
-  source += define_types("Stmt", stmts)
+  source += define_types("Stmt", stmts, profiles)
 
   with open(f"{os.getcwd()}/{include_dir}/stmt", "w") as f:
     f.write(source)